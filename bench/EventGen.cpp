@@ -0,0 +1,210 @@
+/*EventGen.cpp
+ *Synthetic SPS event generator for benchmarking. Writes a DataTree with the same branches as
+ *the evt2root files (so it goes through the analysis like real data) and a cut file with the
+ *gates that fit it, so that the analysis, the aberration correction, the background removal
+ *and peakfit can all run on it without drawing anything.
+ *
+ *The events are light ions from a few states (peaks along the focal plane) plus a continuum,
+ *with the usual x|theta aberration (x = x0 + a*dtheta + b*dtheta^2), another particle group
+ *that the anode and plastic timing gates should remove, events with bad delay line sums and
+ *events with a missing wire. Some events have a silicon hit in mtdc 16-31 (real coincidences
+ *at a fixed time plus randoms). The same seed always gives the same file.
+ *
+ *Usage: ./eventgen <dataname> <number of events> [seed]
+ *  writes dataname.root and dataname_cuts.root (analysis gates and the tilt/fit cuts)
+ *  the number of events can be given as e.g. 1e6
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#include "CutSet.h"
+#include "TFile.h"
+#include "TTree.h"
+#include "TCutG.h"
+#include "TRandom3.h"
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+
+using namespace std;
+
+//the states populated, positions in mm and relative intensities
+const int NPEAKS = 7;
+const Double_t PEAKS[NPEAKS] = {-220, -150, -90, -20, 60, 130, 210};
+const Double_t HEIGHTS[NPEAKS] = {1.0, 0.3, 0.8, 1.0, 0.5, 0.7, 0.9};
+const int NFITS = 5;
+const int FIT_PEAKS[NFITS] = {0, 2, 3, 5, 6}; //the peaks given a fit cut (x|theta polynomial)
+const Double_t SIGMA = 1.2; //peak width, mm
+
+//kinematics and aberration
+const Double_t THETA0 = -0.9, DTHETA = 0.5; //theta is uniform in THETA0 +/- DTHETA
+const Double_t ABER1 = 6.0, ABER2 = 8.0; //mm per unit (theta-THETA0), and its square
+const Double_t WIRE_SEP = 36.0; //mm between the delay lines, as in the analysis
+
+//event mix
+const Double_t BAD_TSUM = 0.10; //random delay line sums
+const Double_t OTHER_GROUP = 0.20; //other particles, cut by the anode and plastic gates
+const Double_t CONTINUUM = 0.15; //fraction of the good events not in a peak
+const Double_t MISSING_WIRE = 0.02;
+const Double_t SI_COINC = 0.30, SI_RANDOM = 0.05;
+
+//timing (delay line sums and anode times give tcheck1 = 1000, tcheck2 = 1050)
+const Double_t TSUM1 = 4000, TSUM2 = 4200;
+const Double_t ANODE1_TIME = 16000, ANODE2_TIME = 16800; //channels, 0.0625 ns
+const Double_t PLASTIC = 500, PLASTIC_SLOPE = 0.05, OTHER_PLASTIC = 540; //ns, ns per mm
+const Double_t SI_TIME = 3000;
+
+Int_t adc(Double_t value) {
+  if (value < 0) return 0;
+  if (value > 4095) return 4095;
+  return (Int_t) value;
+}
+
+/*makeCut
+ *closed TCutG from n points
+ */
+TCutG* makeCut(const char* name, int n, const Double_t *x, const Double_t *y, const char* varx, const char* vary) {
+  TCutG *cut = new TCutG(name, n+1);
+  for (int i=0; i<n; i++) cut->SetPoint(i, x[i], y[i]);
+  cut->SetPoint(n, x[0], y[0]);
+  cut->SetVarX(varx);
+  cut->SetVarY(vary);
+  return cut;
+}
+
+/*writeCuts
+ *Gates matching the generated distributions, in the cut file format of the analysis and fit
+ */
+bool writeCuts(const char* cutName) {
+  CutSet cuts;
+  cuts.min1 = 985; cuts.max1 = 1015;
+  cuts.min2 = 1035; cuts.max2 = 1065;
+  cuts.minSi = (Int_t) SI_TIME-50; cuts.maxSi = (Int_t) SI_TIME+50;
+  Double_t x1x2_x[4] = {-300, 300, 300, -300}, x1x2_y[4] = {-360, 240, 310, -290};
+  cuts.x1x2_cut = makeCut("x1x2_cut", 4, x1x2_x, x1x2_y, "x1", "x2");
+  Double_t anode_x[4] = {-300, 300, 300, -300}, anode_y[4] = {900, 900, 2200, 2200};
+  cuts.fp1anode1_cut = makeCut("fp1anode1_cut", 4, anode_x, anode_y, "x1", "anode1");
+  Double_t plast_x[4] = {-300, 300, 300, -300};
+  Double_t plast_y[4] = {PLASTIC-300*PLASTIC_SLOPE-12, PLASTIC+300*PLASTIC_SLOPE-12,
+                         PLASTIC+300*PLASTIC_SLOPE+12, PLASTIC-300*PLASTIC_SLOPE+12};
+  cuts.fp1plast_cut = makeCut("fp1plast_cut", 4, plast_x, plast_y, "x1", "scint_time");
+  Double_t rf_x[4] = {-300, 300, 300, -300}, rf_y[4] = {-200, -200, 200, 200};
+  cuts.fp1rfwrap_cut = makeCut("fp1rfwrap_cut", 4, rf_x, rf_y, "x1", "rf_scint_wrapped");
+  if (!cuts.save(cutName)) return false;
+
+  //fit cuts: the tilt space, and a band around each fitted peak in x1 vs untilted theta
+  TFile *file = new TFile(cutName, "UPDATE");
+  Double_t tilt_x[4] = {-300, 300, 300, -300};
+  Double_t tilt_y[4] = {THETA0-DTHETA-0.2, THETA0-DTHETA-0.2, THETA0+DTHETA+0.2, THETA0+DTHETA+0.2};
+  makeCut("tilt_space", 4, tilt_x, tilt_y, "x1", "theta")->Write("tilt_space");
+  const int NSTEPS = 13;
+  for (int k=0; k<NFITS; k++) {
+    Double_t x[2*NSTEPS], y[2*NSTEPS];
+    for (int i=0; i<NSTEPS; i++) {
+      Double_t t = -(DTHETA+0.1)+i*2*(DTHETA+0.1)/(NSTEPS-1);
+      Double_t center = PEAKS[FIT_PEAKS[k]]+ABER1*t+ABER2*t*t;
+      x[i] = center-8; y[i] = t;
+      x[2*NSTEPS-1-i] = center+8; y[2*NSTEPS-1-i] = t;
+    }
+    makeCut(Form("f_space%d", k), 2*NSTEPS, x, y, "x1", "theta")->Write(Form("f_space%d", k));
+  }
+  file->Close();
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    cout<<"Usage: ./eventgen <dataname> <number of events> [seed]"<<endl;
+    return 1;
+  }
+  Long64_t nevents = (Long64_t) atof(argv[2]);
+  UInt_t seed = (argc > 3) ? atoi(argv[3]) : 2019;
+  TRandom3 rand(seed);
+
+  Double_t total = 0, cumulative[NPEAKS];
+  for (int i=0; i<NPEAKS; i++) total += HEIGHTS[i];
+  for (int i=0; i<NPEAKS; i++) cumulative[i] = (i ? cumulative[i-1] : 0)+HEIGHTS[i]/total;
+
+  Int_t anode1, anode2, scint1, scint2;
+  Float_t tdiff1, tdiff2, tsum1, tsum2, anode1_time, anode2_time, plastic_time;
+  vector<Int_t> *mtdc = new vector<Int_t>(32);
+
+  TTree::SetMaxTreeSize(1000000000000LL); //keep 10^9 events in one file
+  TFile *output = new TFile(Form("%s.root", argv[1]), "RECREATE");
+  TTree *tree = new TTree("DataTree", "DataTree");
+  tree->Branch("anode1", &anode1, "anode1/I");
+  tree->Branch("anode2", &anode2, "anode2/I");
+  tree->Branch("scint1", &scint1, "scint1/I");
+  tree->Branch("scint2", &scint2, "scint2/I");
+  tree->Branch("fp_plane1_tdiff", &tdiff1, "fp_plane1_tdiff/F");
+  tree->Branch("fp_plane2_tdiff", &tdiff2, "fp_plane2_tdiff/F");
+  tree->Branch("fp_plane1_tsum", &tsum1, "fp_plane1_tsum/F");
+  tree->Branch("fp_plane2_tsum", &tsum2, "fp_plane2_tsum/F");
+  tree->Branch("mtdc1", &mtdc);
+  tree->Branch("anode1_time", &anode1_time, "anode1_time/F");
+  tree->Branch("anode2_time", &anode2_time, "anode2_time/F");
+  tree->Branch("plastic_time", &plastic_time, "plastic_time/F");
+
+  cout<<"Generating "<<nevents<<" events (seed "<<seed<<") into "<<argv[1]<<".root"<<endl;
+  for (Long64_t event=0; event<nevents; event++) {
+    Double_t kind = rand.Rndm();
+    bool other = kind < OTHER_GROUP;
+    bool badSum = !other && kind < OTHER_GROUP+BAD_TSUM;
+
+    Double_t x0;
+    if (rand.Rndm() < CONTINUUM) {
+      x0 = rand.Uniform(-280, 280);
+    } else {
+      Double_t r = rand.Rndm();
+      int peak = 0;
+      while (peak < NPEAKS-1 && r > cumulative[peak]) peak++;
+      x0 = rand.Gaus(PEAKS[peak], SIGMA);
+    }
+    Double_t theta = rand.Uniform(THETA0-DTHETA, THETA0+DTHETA);
+    Double_t t = theta-THETA0;
+    Double_t x1 = x0+ABER1*t+ABER2*t*t;
+    Double_t x2 = x1+WIRE_SEP*theta+rand.Gaus(0, 0.3);
+    tdiff1 = x1*1.83;
+    tdiff2 = x2*1.969;
+
+    anode1_time = ANODE1_TIME+rand.Gaus(0, 16);
+    anode2_time = ANODE2_TIME+rand.Gaus(0, 16);
+    if (badSum) {
+      tsum1 = rand.Uniform(0, 8000);
+      tsum2 = rand.Uniform(0, 8000);
+    } else {
+      tsum1 = rand.Gaus(TSUM1, 3);
+      tsum2 = rand.Gaus(TSUM2, 3);
+    }
+
+    Double_t energy = other ? rand.Gaus(3000, 250) : rand.Gaus(1500, 150);
+    anode1 = adc(energy);
+    anode2 = adc(0.9*energy+rand.Gaus(0, 60));
+    scint1 = adc(rand.Gaus(2000, 200));
+    scint2 = adc(rand.Gaus(1800, 200));
+    plastic_time = ((other ? OTHER_PLASTIC : PLASTIC)+PLASTIC_SLOPE*x1+rand.Gaus(0, 1.5))/0.0625;
+
+    for (int i=0; i<32; i++) (*mtdc)[i] = 0;
+    for (int i=1; i<=4; i++) (*mtdc)[i] = 2000+rand.Integer(1000);
+    if (rand.Rndm() < MISSING_WIRE) (*mtdc)[1+rand.Integer(4)] = 0;
+    (*mtdc)[9] = rand.Integer(65535); //rf
+    Double_t si = rand.Rndm();
+    if (!other && si < SI_COINC) (*mtdc)[16+rand.Integer(16)] = (Int_t) rand.Gaus(SI_TIME, 8);
+    else if (si > 1-SI_RANDOM) (*mtdc)[16+rand.Integer(16)] = rand.Integer(65535);
+
+    tree->Fill();
+    if (event%10000000 == 0 && event > 0) cout<<"\r"<<event<<" events"<<flush;
+  }
+  if (nevents >= 10000000) cout<<endl;
+  output = tree->GetCurrentFile();
+  output->cd();
+  tree->Write(tree->GetName(), TObject::kOverwrite);
+  output->Close();
+
+  if (!writeCuts(Form("%s_cuts.root", argv[1]))) return 1;
+  cout<<"Peaks at";
+  for (int i=0; i<NPEAKS; i++) cout<<" "<<PEAKS[i];
+  cout<<" mm (sigma "<<SIGMA<<" mm)"<<endl;
+  return 0;
+}
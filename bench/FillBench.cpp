@@ -0,0 +1,182 @@
+/*FillBench.cpp
+ *Benchmark of the batched fixed-binning fill path (FastFill) against TH1::Fill, using
+ *histograms shaped like the analysis ones (1200 bin fp position, 600x512 position vs anode).
+ *Checks that the bin contents and entries come out identical and prints the fill rates.
+ *Then checks every binning the analysis uses the same way with random values over and past
+ *the range, every bin edge (as TAxis computes it) and the doubles either side of it,
+ *underflow/overflow values and +/-inf and nan; for 2D histograms edges on one axis go with
+ *random values on the other. The bin contents, entries and statistics have to match.
+ *Usage: ./fillbench [number of fills, default 20000000]
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#include "FastFill.h"
+#include "TH1.h"
+#include "TH2.h"
+#include "TRandom3.h"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+
+using namespace std;
+
+/*times filling h from x (and y) with TH1::Fill or FastFill; returns seconds*/
+double timeFill(TH1 *h, const vector<Double_t> &x, const vector<Double_t> &y, bool fast) {
+  auto start = chrono::steady_clock::now();
+  if (fast) {
+    FastFill f(h);
+    if (y.empty()) for (unsigned int i=0; i<x.size(); i++) f.Fill(x[i]);
+    else for (unsigned int i=0; i<x.size(); i++) f.Fill(x[i], y[i]);
+    f.flush();
+  } else {
+    if (y.empty()) for (unsigned int i=0; i<x.size(); i++) h->Fill(x[i]);
+    else for (unsigned int i=0; i<x.size(); i++) h->Fill(x[i], y[i]);
+  }
+  return chrono::duration<double>(chrono::steady_clock::now()-start).count();
+}
+
+/*number of bins (including under/overflow) where a and b differ*/
+int compare(TH1 *a, TH1 *b) {
+  int ncells = a->GetNcells(), bad = 0;
+  for (int i=0; i<ncells; i++) {
+    if (a->GetBinContent(i) != b->GetBinContent(i)) bad++;
+  }
+  return bad;
+}
+
+/*whether the statistics (sum of weights, of w*x, w*x^2, ...) of a and b agree; they are summed
+ *in another order, so to 1e-9*/
+bool sameStats(TH1 *a, TH1 *b) {
+  Double_t sa[7] = {0}, sb[7] = {0};
+  a->GetStats(sa);
+  b->GetStats(sb);
+  for (int i=0; i<7; i++) {
+    if (std::isnan(sa[i]) || std::isnan(sb[i])) return false;
+    if (fabs(sa[i]-sb[i]) > 1e-9*(fabs(sa[i])+fabs(sb[i]))) return false;
+  }
+  return true;
+}
+
+/*the binnings of the analysis and fit histograms (ny = 0 for a TH1F)*/
+struct Binning {
+  Int_t nx;
+  Double_t xlow, xhigh;
+  Int_t ny;
+  Double_t ylow, yhigh;
+};
+static const Binning BINNINGS[] = {
+  {1200, -300, 300, 0, 0, 0}, {1000, -300, 300, 0, 0, 0}, {65535, 0, 65535, 0, 0, 0},
+  {8192, -4095, 4096, 0, 0, 0}, {8192, 0, 8191, 0, 0, 0},
+  {512, 0, 4095, 512, 0, 4095}, {600, -300, 300, 512, 0, 4095}, {600, -300, 300, 512, 0, 8191},
+  {600, -300, 300, 600, -3, 3}, {600, -300, 300, 300, -3, 3}, {600, -300, 300, 600, -300, 300},
+  {600, -300, 300, 600, 0, 8191}
+};
+
+/*every bin edge of the axis and the doubles just below and above it, then underflow/overflow
+ *and non-finite values*/
+void edgeValues(Int_t nbins, Double_t low, Double_t high, vector<Double_t> &v) {
+  Double_t width = (high-low)/nbins;
+  for (int i=0; i<=nbins; i++) {
+    Double_t edge = low+i*width; //TAxis::GetBinLowEdge
+    v.push_back(edge);
+    v.push_back(nextafter(edge, -HUGE_VAL));
+    v.push_back(nextafter(edge, HUGE_VAL));
+  }
+  Double_t outside[] = {low-width/2, high+width/2, low-1e3*width, high+1e3*width, -1e30, 1e30,
+                        -HUGE_VAL, HUGE_VAL, nan("")};
+  for (int i=0; i<9; i++) v.push_back(outside[i]);
+}
+
+/*fills a histogram of binning b both ways with random and edge values; false if they differ*/
+bool checkBinning(const Binning &b, TRandom3 &rand, Long64_t &nvalues) {
+  TH1 *slow, *fast;
+  if (b.ny == 0) {
+    slow = new TH1F("slowc", "slow", b.nx, b.xlow, b.xhigh);
+    fast = new TH1F("fastc", "fast", b.nx, b.xlow, b.xhigh);
+  } else {
+    slow = new TH2F("slowc", "slow", b.nx, b.xlow, b.xhigh, b.ny, b.ylow, b.yhigh);
+    fast = new TH2F("fastc", "fast", b.nx, b.xlow, b.xhigh, b.ny, b.ylow, b.yhigh);
+  }
+  Double_t xpad = 0.05*(b.xhigh-b.xlow), ypad = 0.05*(b.yhigh-b.ylow);
+  vector<Double_t> x, y, xedges, yedges;
+  for (int i=0; i<1000000; i++) {
+    x.push_back(rand.Uniform(b.xlow-xpad, b.xhigh+xpad));
+    if (b.ny) y.push_back(rand.Uniform(b.ylow-ypad, b.yhigh+ypad));
+  }
+  edgeValues(b.nx, b.xlow, b.xhigh, xedges);
+  for (unsigned int i=0; i<xedges.size(); i++) {
+    x.push_back(xedges[i]);
+    if (b.ny) y.push_back(rand.Uniform(b.ylow-ypad, b.yhigh+ypad));
+  }
+  if (b.ny) {
+    edgeValues(b.ny, b.ylow, b.yhigh, yedges);
+    for (unsigned int i=0; i<yedges.size(); i++) {
+      x.push_back(rand.Uniform(b.xlow-xpad, b.xhigh+xpad));
+      y.push_back(yedges[i]);
+    }
+  }
+  timeFill(slow, x, y, false);
+  timeFill(fast, x, y, true);
+  int bad = compare(slow, fast);
+  bool stats = sameStats(slow, fast);
+  bool same = (bad == 0 && slow->GetEntries() == fast->GetEntries() && stats);
+  if (!same) {
+    cout<<"  "<<b.nx<<" bins ["<<b.xlow<<", "<<b.xhigh<<")";
+    if (b.ny) cout<<" x "<<b.ny<<" bins ["<<b.ylow<<", "<<b.yhigh<<")";
+    cout<<": "<<bad<<" differing bins, entries "<<slow->GetEntries()<<" / "<<fast->GetEntries()
+        <<(stats ? "" : ", statistics differ")<<endl;
+  }
+  nvalues += x.size();
+  delete slow;
+  delete fast;
+  return same;
+}
+
+int main(int argc, char* argv[]) {
+  int nfills = (argc > 1) ? atoi(argv[1]) : 20000000;
+  TH1::AddDirectory(kFALSE);
+  TRandom3 rand(12345);
+  vector<Double_t> x(nfills), y(nfills), none;
+  for (int i=0; i<nfills; i++) {
+    //peaks on a flat background, a few percent out of range
+    x[i] = (i%4) ? rand.Gaus(-150+100*(i%4), 15) : rand.Uniform(-320, 320);
+    y[i] = rand.Gaus(1500, 600);
+  }
+
+  int status = 0;
+  for (int d=1; d<=2; d++) {
+    TH1 *slow, *fast;
+    if (d == 1) {
+      slow = new TH1F("slow1", "slow", 1200, -300, 300);
+      fast = new TH1F("fast1", "fast", 1200, -300, 300);
+    } else {
+      slow = new TH2F("slow2", "slow", 600, -300, 300, 512, 0, 4095);
+      fast = new TH2F("fast2", "fast", 600, -300, 300, 512, 0, 4095);
+    }
+    const vector<Double_t> &yvals = (d == 1) ? none : y;
+    double tslow = timeFill(slow, x, yvals, false);
+    double tfast = timeFill(fast, x, yvals, true);
+    int bad = compare(slow, fast);
+    cout<<(d == 1 ? "TH1F 1200 bins:    " : "TH2F 600x512 bins: ")
+        <<"Fill "<<nfills/tslow/1e6<<" M/s, FastFill "<<nfills/tfast/1e6<<" M/s (x"<<tslow/tfast<<")"<<endl;
+    cout<<"  differing bins: "<<bad<<", entries "<<slow->GetEntries()<<" / "<<fast->GetEntries()
+        <<", mean "<<slow->GetMean()<<" / "<<fast->GetMean()<<endl;
+    if (bad || slow->GetEntries() != fast->GetEntries()) status = 1;
+    delete slow;
+    delete fast;
+  }
+
+  Long64_t nvalues = 0;
+  int nbinnings = sizeof(BINNINGS)/sizeof(BINNINGS[0]), nbad = 0;
+  for (int i=0; i<nbinnings; i++) {
+    if (!checkBinning(BINNINGS[i], rand, nvalues)) nbad++;
+  }
+  cout<<"Analysis binnings: "<<nbinnings-nbad<<" of "<<nbinnings<<" match ("<<nvalues
+      <<" random, bin edge, under/overflow and inf/nan values)"<<endl;
+  if (nbad) status = 1;
+  if (status) cout<<"FastFill does NOT match TH1::Fill"<<endl;
+  return status;
+}
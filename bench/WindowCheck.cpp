@@ -0,0 +1,60 @@
+/*WindowCheck.cpp
+ *Check of the windowed area gradient PeakFit propagates the area errors with
+ *(PeakShapes::windowArea) against central finite differences of the area, for every peak shape,
+ *a few peak widths and area windows. Prints the largest relative difference of each shape and
+ *exits with 1 if any is over 1e-3 (differences of derivatives that are zero are taken relative to
+ *1e-6 of the area per width).
+ *Usage: ./windowcheck
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#include "PeakShapes.h"
+#include <iostream>
+#include <cmath>
+
+using namespace std;
+
+/*largest relative difference between the analytic gradient of the window area and central
+ *finite differences of it*/
+Double_t worstGradient(const PeakShape *shape, const Double_t *p, Double_t window) {
+  Double_t grad[PeakShapes::MAX_PARS], q[PeakShapes::MAX_PARS], unused[PeakShapes::MAX_PARS];
+  Double_t area = PeakShapes::windowArea(shape, p, window, grad);
+  Double_t floor = 1e-6*area/fabs(p[2]); //for derivatives that are zero (the centroid's of a symmetric peak)
+  Double_t worst = 0;
+  for (int j=0; j<shape->npars; j++) {
+    for (int k=0; k<shape->npars; k++) q[k] = p[k];
+    Double_t step = 1e-5*(fabs(p[j]) > 1e-3 ? fabs(p[j]) : 1e-3);
+    q[j] = p[j]+step;
+    Double_t up = PeakShapes::windowArea(shape, q, window, unused);
+    q[j] = p[j]-step;
+    Double_t down = PeakShapes::windowArea(shape, q, window, unused);
+    Double_t numeric = (up-down)/(2.0*step);
+    Double_t scale = fabs(numeric) > fabs(grad[j]) ? fabs(numeric) : fabs(grad[j]);
+    if (scale < floor) scale = floor;
+    if (fabs(numeric-grad[j])/scale > worst) worst = fabs(numeric-grad[j])/scale;
+  }
+  return worst;
+}
+
+int main() {
+  const Double_t SIGMAS[] = {0.5, 2.0, 8.0};
+  const Double_t WINDOWS[] = {1.0, 2.8, 5.0};
+  bool ok = true;
+  for (int s=0; s<PeakShapes::NSHAPES; s++) {
+    const PeakShape *shape = &PeakShapes::SHAPES[s];
+    Double_t worst = 0;
+    for (int i=0; i<3; i++) {
+      Double_t g[3] = {150.0, 12.5, SIGMAS[i]}, p[PeakShapes::MAX_PARS];
+      shape->init(g, p);
+      for (int w=0; w<3; w++) {
+        Double_t off = worstGradient(shape, p, WINDOWS[w]);
+        if (off > worst) worst = off;
+      }
+    }
+    bool good = (worst <= 1e-3);
+    cout<<shape->name<<": largest relative difference "<<worst<<(good ? "" : " FAILED")<<endl;
+    if (!good) ok = false;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+#!/bin/bash
+#runbench.sh
+#Benchmark of the whole chain on synthetic data (see EventGen.cpp), run by make bench.
+#For each number of events: generates the data (once, same seed every time), then times the
+#analysis reading the DataTree (ingest + sort, the cache is removed first), the analysis again
+#from the event cache, the aberration correction, background removal and a batch peakfit of
+#x1_corr. Nothing is drawn: all of the cuts come from the generated cut file.
+#Before that it checks the peak area window gradient peakfit propagates the area errors with
+#(./windowcheck, see WindowCheck.cpp) and runs the histogram fill benchmark (./fillbench, see
+#FillBench.cpp, kept in bench/results/fillbench.log), and stops if either fails.
+#Prints events/s and peak memory of each stage and keeps them in bench/results/bench_<N>.csv,
+#along with the -t stage report of each analysis run, for comparing against earlier runs.
+#
+#Usage: bench/runbench.sh [number of events ...] (default 1e5 1e6)
+#
+#Gordon M. -- Aug 2019
+
+cd "$(dirname "$0")/.."
+SIZES=${@:-"1e5 1e6"}
+DATADIR=bench/data
+RESDIR=bench/results
+mkdir -p $DATADIR $RESDIR
+
+if [ -x /usr/bin/time ]; then
+  TIMER="/usr/bin/time -f %e:%M -o"
+else
+  echo "No /usr/bin/time, peak memory will not be reported"
+  TIMER=""
+fi
+
+#runs a stage: name, events, command...; output goes to the stage's log file
+stage() {
+  local name=$1 events=$2
+  shift 2
+  local log=$RESDIR/$base.$name.log
+  local seconds rss
+  if [ -n "$TIMER" ]; then
+    $TIMER $RESDIR/time.txt "$@" > $log 2>&1 < /dev/null
+    local status=$?
+    seconds=$(tail -1 $RESDIR/time.txt | cut -d: -f1)
+    rss=$(tail -1 $RESDIR/time.txt | cut -d: -f2)
+  else
+    local start=$(date +%s.%N)
+    "$@" > $log 2>&1 < /dev/null
+    local status=$?
+    seconds=$(echo "$(date +%s.%N) - $start" | bc)
+    rss=0
+  fi
+  if [ $status -ne 0 ]; then
+    echo "$name failed, see $log"
+    return 1
+  fi
+  local rate="-"
+  if [ "$events" != "-" ]; then rate=$(echo "$events $seconds" | awk '{ if ($2 > 0) printf "%.0f", $1/$2; else print "-" }'); fi
+  local mb=$(echo $rss | awk '{ printf "%.1f", $1/1024 }')
+  printf "  %-12s %10s s %14s events/s %10s MB\n" $name $seconds $rate $mb
+  echo "$name,$events,$seconds,$rate,$mb" >> $csv
+}
+
+./windowcheck || { echo "windowcheck failed, peakfit's windowed area errors are not reliable"; exit 1; }
+echo "Histogram fills:"
+./fillbench | tee $RESDIR/fillbench.log
+[ ${PIPESTATUS[0]} -eq 0 ] || { echo "fillbench failed, FastFill does not match TH1::Fill"; exit 1; }
+
+for size in $SIZES; do
+  events=$(echo $size | awk '{ printf "%.0f", $1 }')
+  base=synth_$events
+  data=$DATADIR/$base
+  csv=$RESDIR/bench_$events.csv
+  echo "# $(git rev-parse --short HEAD 2>/dev/null) $(date)" > $csv
+  echo "stage,events,seconds,events_per_s,peak_rss_mb" >> $csv
+  echo "$events events:"
+  if [ ! -f $data.root ] || [ ! -f ${data}_cuts.root ]; then
+    stage generate $events ./eventgen $data $events || continue
+  fi
+  cuts=${data}_cuts.root
+  rm -f ${data}_cache.evc
+  stage ingest_sort $events ./analysis -a -q -c $cuts -t $RESDIR/$base.ingest_sort.json $data || continue
+  stage cached_sort $events ./analysis -a -q -c $cuts -t $RESDIR/$base.cached_sort.json $data || continue
+  stage correction $events ./analysis -f -q -c $cuts -t $RESDIR/$base.correction.json $data || continue
+  stage background - ./analysis -b -q $data || continue
+  rm -f $RESDIR/$base.peaks.txt
+  stage peakfit - ./peakfit -a -w 2.8 -n x1_corr -R -250:250 -i 20 ${data}_corr.root $RESDIR/$base.peaks.txt || continue
+  echo "  results in $csv, fitted peaks in $RESDIR/$base.peaks.txt"
+done
+rm -f $RESDIR/time.txt
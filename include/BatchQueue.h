@@ -0,0 +1,58 @@
+/*BatchQueue.h
+ *Bounded ring of event batches connecting the DataTree reader thread (producer) to the
+ *analysis (consumer) while the raw file is ingested. The producer decompresses and copies
+ *BATCH_ENTRIES events at a time into a free batch and hands it over; the consumer stores and
+ *histograms the batch and gives the slot back. All batches are allocated up front, so
+ *nothing is allocated while running.
+ *
+ *Counters tell which side is the bottleneck: if the producer is mostly waiting for a free
+ *slot (queue full) the run is CPU bound, if the consumer is mostly waiting for a full batch
+ *(queue empty) it is I/O bound.
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#ifndef BATCHQUEUE_H
+#define BATCHQUEUE_H
+
+#include "TROOT.h"
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+/*one batch of raw DataTree events, same content as the analysis storage vectors*/
+struct EventBatch {
+  Int_t n; //events in the batch
+  vector<Int_t> anode1, anode2, scint1, scint2;
+  vector<Float_t> tdiff1, tdiff2, tsum1, tsum2, scint1_time, anode1_time, anode2_time;
+  vector<Int_t> mtdc; //nmtdc channels per event
+};
+
+class BatchQueue {
+
+  public:
+    BatchQueue(Int_t nslots, Int_t batchEntries, Int_t nmtdc);
+    EventBatch* acquire(); //producer: wait for a free batch
+    void push(EventBatch *batch); //producer: hand a full batch to the consumer
+    void finish(); //producer: no more batches
+    EventBatch* pop(); //consumer: wait for a full batch, NULL when finished
+    void release(EventBatch *batch); //consumer: give the batch back
+    void report();
+
+  private:
+    vector<EventBatch> batches;
+    vector<EventBatch*> freeRing, fullRing; //fixed size rings of slot pointers
+    Int_t freeHead, freeCount, fullHead, fullCount;
+    bool done;
+    mutex lock;
+    condition_variable freeReady, fullReady;
+
+    /*instrumentation*/
+    Long64_t nbatches, producerStalls, consumerStalls, depthSum;
+    Int_t maxDepth;
+    Double_t producerWait, consumerWait; //seconds
+};
+
+#endif
@@ -0,0 +1,48 @@
+/*ChannelMap.h
+ *Which mtdc channels are used and what they are. Only these are copied out of the mtdc1
+ *branch, into a compact row per event that the sorts index by role instead of by channel:
+ *  row[FP1], row[FP1+1]  front delay line (fp plane 1) signals
+ *  row[FP2], row[FP2+1]  back delay line (fp plane 2) signals
+ *  row[RF]               RF
+ *  row[SI] ... row[SI+nsi()-1]  silicon detectors, any number of them
+ *Without a map file the evt2root layout is used (fp1 1 2, fp2 3 4, rf 9, si 16-31).
+ *
+ *Map file, one role per line followed by its mtdc channels, # for comments:
+ *  fp1 1 2
+ *  fp2 3 4
+ *  rf 9          (optional, reads as 0 without it)
+ *  si 16-31 40   (optional, any list of channels and ranges)
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#ifndef CHANNELMAP_H
+#define CHANNELMAP_H
+
+#include "TROOT.h"
+#include <vector>
+#include <string>
+
+using namespace std;
+
+class ChannelMap {
+
+  public:
+    enum Offset {FP1=0, FP2=2, RF=4, SI=5}; //positions in the compact row
+
+    ChannelMap();
+    bool load(const char* filename);
+    Int_t width() const { return source.size(); } //channels per event
+    Int_t nsi() const { return source.size()-SI; }
+    void gather(const vector<Int_t> &mtdc, Int_t *row) const { //compact row of one event
+      Int_t size = mtdc.size();
+      for (unsigned int i=0; i<source.size(); i++) row[i] = (source[i] >= 0 && source[i] < size) ? mtdc[source[i]] : 0;
+    }
+    string signature() const; //name for the event cache column, changes with the map
+    void print() const;
+
+  private:
+    vector<Int_t> source; //mtdc channel of each row position, -1 if not connected
+};
+
+#endif
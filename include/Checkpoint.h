@@ -0,0 +1,66 @@
+/*Checkpoint.h
+ *Checkpoints of a long event loop (the sort, the x|theta correction) kept in its output file,
+ *so that a job that dies (out of memory, pre-empted, over the wall-clock limit) can be started
+ *again and resume from the last checkpoint with the same final results (-R seconds).
+ *A checkpoint writes the histograms filled so far, AutoSaves the output tree (its entries up
+ *to here survive a crash) and writes the record <stage>_checkpoint, a TVectorD:
+ *  version, next entry, tree entries, flags, complete, input size, input time, extra...
+ *with <stage>_settings (a TNamed) next to it. The flags and extra numbers belong to the stage
+ *(e.g. which histograms were already complete, the cut flow counts). A record is only used
+ *if the input file and the settings are the same and the tree has the recorded entries.
+ *When the loop is done the record is marked complete, and a resumed job skips the stage.
+ *The tree's own AutoSave has to be off (SetAutoSave(0)), or ROOT writes tree headers with more
+ *entries than the last record between checkpoints and the record is no longer usable.
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "TROOT.h"
+#include "TH1.h"
+#include "TTree.h"
+#include "TFile.h"
+#include "TObjArray.h"
+#include <vector>
+#include <string>
+#include <chrono>
+
+using namespace std;
+
+class Checkpoint {
+
+  public:
+    struct State {
+      Long64_t cursor; //next entry to process
+      Long64_t treeEntries;
+      UInt_t flags;
+      bool complete;
+      vector<Double_t> extra;
+      State() : cursor(0), treeEntries(0), flags(0), complete(false) {}
+    };
+    static const Int_t CHECK_ENTRIES = 4096; //entries between looks at the clock in a loop
+
+    Checkpoint(const char* stageName);
+    void setPeriod(Int_t seconds);
+    bool isEnabled() const { return period > 0; }
+    void setSource(const char* sourceName, const string &settings);
+    bool find(const char* fileName, const char* treeName, State &state);
+    bool due() const { //time for the next checkpoint
+      return period > 0 && chrono::duration<double>(chrono::steady_clock::now()-last).count() >= period;
+    }
+    void save(TFile *file, const State &state, TObjArray *objects, TTree *tree);
+    static void restore(TDirectory *file, const vector<TH1*> &histos); //adds the saved contents
+
+  private:
+    static const Int_t VERSION = 1;
+    static const Int_t FIXED = 7; //record entries before the extra ones
+    bool sourceInfo(Long64_t &size, Long64_t &mtime) const;
+
+    string stage, source, settings;
+    Int_t period; //seconds, 0 = off
+    chrono::steady_clock::time_point last;
+};
+
+#endif
@@ -0,0 +1,69 @@
+/*CutFlow.h
+ *Cut-flow accounting for the gates of sort_full. Every event gets a mask with one bit per
+ *gate it passes (the same mask is written to the SortTree as gateMask, so the events can be
+ *re-gated later without sorting again). In the loop a Counter only counts how often each mask
+ *value comes up (one increment per event, one Counter per filling thread), and everything
+ *else is worked out from those counts at the end:
+ *  passed(g)   -- events passing gate g on its own
+ *  through(g)  -- events passing g and every gate before it (in the order of the Gate enum,
+ *                 the order sort_full applies them), whose ratios are the sequential efficiencies
+ *The gates after WIRES are only evaluated for events with all four delay line signals, so
+ *passed(g) counts among those. Written out as the cut_flow/gate_pass histograms and a text
+ *summary.
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#ifndef CUTFLOW_H
+#define CUTFLOW_H
+
+#include "TROOT.h"
+#include "TH1.h"
+#include <vector>
+#include <mutex>
+#include <ostream>
+
+using namespace std;
+
+class CutFlow {
+
+  public:
+    enum Gate {WIRES, TCHECK1, TCHECK2, FP1PLAST, X1X2, FP1ANODE1, NGATES};
+    static const UInt_t ACCEPTED = (1<<NGATES)-1; //mask of an event that passes everything (cutFlag)
+    static const char* gateName(int gate);
+    static UInt_t bit(Gate gate) { return 1u<<gate; }
+    static UInt_t parseGates(const char* list); //"all" or gate names separated by commas, 0 if unknown
+
+    class Counter {
+      public:
+        Counter();
+        void add(UInt_t mask) { counts[mask & ACCEPTED]++; }
+
+      private:
+        friend class CutFlow;
+        Long64_t counts[1<<NGATES];
+    };
+
+    CutFlow();
+    ~CutFlow();
+    Counter* counter(); //one per thread
+    void merge(); //adds up the counters, after the filling threads are done
+    void reset();
+    Long64_t count(UInt_t mask) const { return counts[mask & ACCEPTED]; } //events with this mask, after merge
+    void addCount(UInt_t mask, Long64_t n); //e.g. counts restored from a checkpoint
+
+    Long64_t total() const;
+    Long64_t passed(int gate) const;
+    Long64_t through(int gate) const;
+    TH1D* flowHisto(); //cut_flow: all events, then through(g) for each gate
+    TH1D* passHisto(); //gate_pass: passed(g) for each gate
+    void print(ostream &output);
+    bool write(const char* filename);
+
+  private:
+    vector<Counter*> counters;
+    Long64_t counts[1<<NGATES];
+    mutex lock;
+};
+
+#endif
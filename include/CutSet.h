@@ -0,0 +1,36 @@
+/*CutSet.h
+ *The gates made by hand in the analysis (tcheck windows and the 2D TCutGs), saved to and
+ *loaded from a ROOT file so that a run can be re-sorted without redrawing them.
+ *The file holds the cuts under their analysis names and a TVectorD "tcheck_windows"
+ *(fp1 min, fp1 max, fp2 min, fp2 max, si min, si max). The same set can be kept in a
+ *directory of another file (the histogram file keeps the sort's in sort_gates, see regate).
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#ifndef CUTSET_H
+#define CUTSET_H
+
+#include "TROOT.h"
+#include "TCutG.h"
+#include "TDirectory.h"
+
+class CutSet {
+
+  public:
+    CutSet();
+    bool load(const char* filename);
+    bool load(TDirectory *dir, const char* label);
+    bool save(const char* filename);
+    void write(); //windows and cuts to the current directory
+    void writeWindows();
+    static bool sameCut(TCutG *a, TCutG *b);
+
+    Int_t min1, max1, min2, max2, minSi, maxSi;
+    TCutG *x1x2_cut,
+    *fp1anode1_cut,
+    *fp1plast_cut,
+    *fp1rfwrap_cut;
+};
+
+#endif
@@ -0,0 +1,82 @@
+/*DataSchema.h
+ *The raw DataTree branches the analysis reads, declared once with their types and the
+ *variables they are read into. open() checks the whole list against the tree before anything
+ *is read: every branch has to be there with the declared type (a single Int_t or Float_t
+ *leaf, or a vector<int>), otherwise each problem is printed and nothing is bound. Only the
+ *declared branches are switched on and put in the tree cache.
+ *Reading is done column by column: read(c, entry) reads one entry of one branch, and
+ *readColumn() a range of entries of one branch straight into an array, so a batch of events
+ *is filled one column at a time instead of entry by entry over all branches. The Int_t and
+ *Float_t columns use ROOT's bulk reads (a whole basket deserialized into a buffer at once,
+ *kept for the next range); the vector<int> column, which bulk reads don't cover, and any
+ *branch ROOT refuses a bulk read for are read entry by entry.
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#ifndef DATASCHEMA_H
+#define DATASCHEMA_H
+
+#include "TROOT.h"
+#include "TTree.h"
+#include "TBranch.h"
+#include "TBufferFile.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstring>
+
+using namespace std;
+
+class DataSchema {
+
+  public:
+    enum Type {INT, FLOAT, INT_VECTOR};
+    static const Long64_t CACHE_SIZE = 64*1024*1024; //tree cache for the declared branches
+
+    DataSchema();
+    void clear();
+    void add(const char* name, Int_t *var);
+    void add(const char* name, Float_t *var);
+    void add(const char* name, vector<Int_t> **var);
+    bool open(TTree *tree); //checks and binds the declared branches, false if any doesn't match
+    Int_t size() const { return columns.size(); }
+    void read(int c, Long64_t entry) { columns[c].branch->GetEntry(entry); }
+    void readEntry(Long64_t entry) { //all columns of one entry
+      for (unsigned int c=0; c<columns.size(); c++) columns[c].branch->GetEntry(entry);
+    }
+    template<class T> void readColumn(int c, Long64_t first, Int_t n, const T *var, T *out) {
+      Int_t i = 0;
+      while (i < n) { //a basket at a time
+        Int_t available;
+        const char *values = bulkValues(c, first+i, available);
+        if (!values) break;
+        Int_t m = (available < n-i) ? available : n-i;
+        memcpy(out+i, values, m*sizeof(T));
+        i += m;
+      }
+      TBranch *branch = columns[c].branch;
+      for (; i<n; i++) { //no bulk read
+        branch->GetEntry(first+i);
+        out[i] = *var;
+      }
+    }
+
+  private:
+    struct Column {
+      string name;
+      Type type;
+      void *address;
+      TBranch *branch;
+      shared_ptr<TBufferFile> bulk; //the last basket bulk read, deserialized
+      Long64_t bulkFirst; //its first entry
+      Int_t bulkCount; //its entries, 0 = none, -1 = no bulk reads for this branch
+    };
+    void add(const char* name, Type type, void *address);
+    const char* bulkValues(int c, Long64_t entry, Int_t &available);
+    static const char* typeName(Type type);
+
+    vector<Column> columns;
+};
+
+#endif
@@ -0,0 +1,70 @@
+/*DenseHist.h
+ *Dense 1D/2D histogram for filling one histogram from several threads at once. ROOT histograms
+ *can't be filled concurrently, and a clone per thread costs a lot of memory for the 600x512
+ *TH2Fs. A DenseHist copies the (fixed) binning of a TH1F/TH2F and keeps the bin counts in one
+ *contiguous array in ROOT's global bin order (under/overflow included). Each thread fills
+ *through its own Filler:
+ *  SHARDED -- every filler has a private copy of the bins, summed at the end (small histograms)
+ *  ATOMIC  -- all fillers increment the shared bins atomically (big histograms)
+ *  AUTO    -- sharded if all the shards together stay small, otherwise atomic
+ *The statistics (entries and the weighted sums used for mean/RMS) are kept per filler in
+ *either mode. addTo adds everything into the ROOT histogram, the same as filling it directly
+ *(up to the summation order of the statistics). Fills are unit weight, like all of the
+ *analysis fills.
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#ifndef DENSEHIST_H
+#define DENSEHIST_H
+
+#include "TROOT.h"
+#include "TH1.h"
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+using namespace std;
+
+class DenseHist {
+
+  public:
+    enum Mode {SHARDED, ATOMIC, AUTO};
+
+    class Filler {
+      public:
+        Filler(DenseHist *parent);
+        void Fill(Double_t x);
+        void Fill(Double_t x, Double_t y);
+
+      private:
+        friend class DenseHist;
+        DenseHist *hist;
+        vector<UInt_t> shard; //empty in ATOMIC mode
+        Long64_t entries;
+        Double_t stats[7]; //sumw, sumw2, sumwx, sumwx2, sumwy, sumwy2, sumwxy (ROOT's order)
+    };
+
+    DenseHist(TH1 *histo, Int_t nthreads, Mode mode=AUTO);
+    ~DenseHist();
+    Filler* filler(); //one per thread
+    void addTo(TH1 *histo); //after all of the filling threads are done
+    Mode GetMode();
+
+    static const Long64_t SHARD_BYTES = 8*1048576; //AUTO: most memory for all shards together
+
+  private:
+    Int_t findBin(Double_t v, Int_t nbins, Double_t low, Double_t high);
+    void count(Filler *f, Int_t bin);
+
+    Int_t dim;
+    Int_t nbinsx, nbinsy;
+    Double_t xmin, xmax, ymin, ymax;
+    Int_t ncells;
+    Mode fillMode;
+    vector<atomic<UInt_t>> bins; //ATOMIC mode
+    vector<Filler*> fillers;
+    mutex lock;
+};
+
+#endif
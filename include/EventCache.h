@@ -0,0 +1,84 @@
+/*EventCache.h
+ *Columnar cache of the raw event data used by the analysis, so that re-running the analysis
+ *(iterating cuts) doesn't need to read and deserialize the evt2root DataTree again.
+ *The analysis registers its storage vectors as columns; the first run writes them to the cache,
+ *later runs read the cache straight back into the same vectors.
+ *
+ *File layout (all blocks aligned to 64 bytes so the file can be memory mapped):
+ *  header | column table | chunk index | data blocks
+ *Events are stored in chunks of CHUNK_ENTRIES; each chunk has one block per column and channel
+ *(so a 32 channel column is 32 streams). Blocks are byte-shuffled and LZ4 compressed with ROOT's
+ *compression library; a block that doesn't compress is stored raw.
+ *Reading maps the file and splits the chunk index into contiguous ranges decoded by separate
+ *threads, each writing its own event range of the columns.
+ *The cache records the size and modification time of the raw file it was made from and is
+ *ignored if they don't match anymore.
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#ifndef EVENTCACHE_H
+#define EVENTCACHE_H
+
+#include "TROOT.h"
+#include <vector>
+#include <string>
+#include <cstdio>
+
+using namespace std;
+
+class EventCache {
+
+  public:
+    EventCache();
+    void addColumn(const char* name, vector<Int_t> *column, Int_t width=1);
+    void addColumn(const char* name, vector<Float_t> *column, Int_t width=1);
+    bool write(const char* filename, const char* sourcename, Long64_t nentries);
+    bool read(const char* filename, const char* sourcename, Int_t nthreads=0);
+    Long64_t GetEntries();
+
+    static const UInt_t CHUNK_ENTRIES = 65536;
+
+  private:
+    struct Header {
+      char magic[8];
+      UInt_t version;
+      UInt_t ncolumns;
+      Long64_t nentries;
+      UInt_t chunkEntries;
+      UInt_t nchunks;
+      Long64_t sourceSize;
+      Long64_t sourceTime;
+    };
+    struct ColumnInfo {
+      char type; //'I' or 'F', both 4 bytes
+      char name[31];
+      Int_t width; //values per event
+    };
+    struct Block {
+      Long64_t offset;
+      UInt_t zsize; //stored size, equal to rawsize if not compressed
+      UInt_t rawsize;
+    };
+    struct Column {
+      ColumnInfo info;
+      void *data; //vector<Int_t>* or vector<Float_t>*
+    };
+
+    bool sourceStat(const char* sourcename, Long64_t &size, Long64_t &mtime);
+    bool readHeader(const char* map, size_t size, const char* sourcename);
+    void decodeChunks(const char* map, UInt_t firstChunk, UInt_t lastChunk, bool *good);
+    char* columnData(Column &col);
+    void resizeColumn(Column &col, Long64_t n);
+    void shuffle(const char* in, char* out, UInt_t n);
+    void unshuffle(const char* in, char* out, UInt_t n);
+    void gather(Column &col, Int_t channel, Long64_t first, UInt_t n, char* out);
+    void scatter(Column &col, Int_t channel, Long64_t first, UInt_t n, const char* in);
+
+    vector<Column> columns;
+    Int_t nstreams; //sum of the column widths
+    Header header;
+    vector<Block> index; //nchunks*nstreams
+};
+
+#endif
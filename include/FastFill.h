@@ -0,0 +1,61 @@
+/*FastFill.h
+ *Fast path for filling a TH1F/TH2F with fixed binning in the hot sort loops. Fill only
+ *stores the value; every BATCH values (and at flush) the bins are computed in one tight loop
+ *from a precomputed inverse bin width and incremented directly in the histogram's array, and
+ *the statistics are summed in a separate loop (under/overflow, inf and nan left out). Gives the same bin contents and
+ *entries as TH1::Fill: the bin is exactly TAxis::FindFixBin's (the multiplication is only
+ *replaced by FindFixBin's division when a value is right at a bin edge, where the two can
+ *round differently). Call flush before the histogram is drawn, written or read.
+ *Anything else (variable bins, Sumw2 errors, other types) just goes through the normal Fill.
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#ifndef FASTFILL_H
+#define FASTFILL_H
+
+#include "TROOT.h"
+#include "TH1.h"
+
+class FastFill {
+
+  public:
+    FastFill(TH1 *histo);
+    void Fill(Double_t x) {
+      xs[n] = x;
+      if (++n == BATCH) flush();
+    }
+    void Fill(Double_t x, Double_t y) {
+      xs[n] = x;
+      ys[n] = y;
+      if (++n == BATCH) flush();
+    }
+    void flush();
+
+    static const Int_t BATCH = 1024;
+
+  private:
+    struct Axis {
+      Int_t nbins;
+      Double_t low, high, inv;
+      void set(TAxis *axis);
+      Int_t bin(Double_t v) const {
+        if (v < low) return 0;
+        if (!(v < high)) return nbins+1;
+        Double_t t = (v-low)*inv;
+        Int_t b = (Int_t) t;
+        if (t-b < 1e-6 || b+1-t < 1e-6) b = (Int_t) (nbins*(v-low)/(high-low)); //at an edge, do it FindFixBin's way
+        return 1+b;
+      }
+    };
+
+    TH1 *hist;
+    Float_t *array; //NULL if this histogram can't use the fast path
+    Int_t dim;
+    Axis ax, ay;
+    Int_t n;
+    Double_t xs[BATCH], ys[BATCH];
+    Int_t bins[BATCH];
+};
+
+#endif
@@ -0,0 +1,102 @@
+/*GateGraph.h
+ *Gates declared as a graph and compiled into one predicate that is evaluated over a batch of
+ *events at a time. A gate is one of
+ *  window    low < var < high (exclusive bounds, like the tcheck windows)
+ *  notempty  var > 1 (a signal was recorded)
+ *  cut       (varx, vary) inside a polygon; the points are copied out of the TCutG (or given),
+ *            and the test is the same crossing rule as TCutG::IsInside
+ *  all       no test of its own
+ *and passes only if every gate it needs passes too, so gates can be built out of other gates.
+ *Gates with a bit set their bit of the event's mask; the others are internal steps.
+ *
+ *compile() flattens the gates needed by the selected bits into a list of operations in
+ *dependency order, each reading its variables from columns. evaluate() runs every operation
+ *over the whole batch: the tests are comparisons combined with bitwise ops, without branching
+ *on the event, so the loops vectorize. Gates with a bit outside the selection are not
+ *evaluated but taken from a given mask (re-gating). The time spent and the number of events
+ *passing are kept for each operation.
+ *
+ *Gate file (-G), one gate per line, # for comments. Every gate of the file gets a bit of the
+ *gate mask after the analysis gates; "require" makes a gate part of the full selection:
+ *  window tof scint_time 20 80 needs wires
+ *  cut band x1 anode1 -100 0 100 0 100 2000 -100 2000 needs wires
+ *  all good needs tof band
+ *  require good
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#ifndef GATEGRAPH_H
+#define GATEGRAPH_H
+
+#include "TROOT.h"
+#include "TCutG.h"
+#include <vector>
+#include <string>
+#include <ostream>
+
+using namespace std;
+
+class GateGraph {
+
+  public:
+    enum Kind {WINDOW, NOTEMPTY, CUT, ALL};
+    static const Int_t MAX_BITS = 32;
+
+    GateGraph();
+    void clear();
+    void addWindow(const char* name, const char* var, Float_t low, Float_t high);
+    void addNotEmpty(const char* name, const char* var);
+    void addCut(const char* name, const char* varX, const char* varY, const TCutG *cut);
+    void addCut(const char* name, const char* varX, const char* varY, const vector<Double_t> &x, const vector<Double_t> &y);
+    void addAll(const char* name);
+    void need(const char* name, const char* other); //name passes only if other does
+    void setBit(const char* name, Int_t bit);
+    bool load(const char* filename, Int_t firstBit);
+    bool merge(const GateGraph &other);
+    UInt_t outputs() const; //bits of every gate with one
+    UInt_t required() const; //bits of the required gates
+    vector<string> names() const; //gates with a bit
+
+    bool compile(UInt_t selection);
+    const vector<string>& variables() const { return vars; } //columns evaluate() reads, in order
+    void evaluate(Int_t n, const Float_t* const *columns, const UInt_t *given, UInt_t *mask);
+    void print(ostream &output) const;
+    void report() const; //time and passes of each gate to the run report
+
+  private:
+    struct Node {
+      string name;
+      Kind kind;
+      string varX, varY;
+      Float_t low, high;
+      vector<Double_t> x, y; //polygon points
+      vector<string> needs;
+      Int_t bit; //-1 if internal
+      bool require;
+    };
+    struct Op {
+      Int_t node;
+      Kind kind;
+      Int_t x, y; //variable columns
+      Float_t low, high;
+      Int_t firstEdge, nedges;
+      vector<Int_t> inputs; //operations that have to pass too
+      vector<Int_t> givenBits; //gates taken from the given mask that have to pass too
+      Int_t bit;
+      Long64_t events, passed;
+      Double_t seconds;
+    };
+    Int_t find(const string &name) const;
+    Int_t variable(const string &name);
+    bool visit(Int_t node, UInt_t selection, vector<Int_t> &state, vector<Int_t> &opOf);
+
+    vector<Node> nodes;
+    vector<Op> ops;
+    vector<string> vars;
+    vector<Double_t> edgeX1, edgeY1, edgeX2, edgeY2, edgeDY; //polygon edges of the compiled cuts
+    vector<vector<UChar_t> > results; //pass/fail of each operation for the batch
+    UInt_t compiled; //selected bits
+};
+
+#endif
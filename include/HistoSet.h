@@ -0,0 +1,57 @@
+/*HistoSet.h
+ *The histograms filled by one per-event analysis step. A step fills through h[i]->Fill(...),
+ *which goes either straight to the ROOT histogram or, for a parallel pass, to a per-thread
+ *DenseHist filler (see DenseHist.h): makeDense gives the shared dense histograms, forThread
+ *a set filling them from one thread, and addDense puts the result into the ROOT histograms.
+ *A set can also fill its histograms through the batched fast path (FastFill, useFast); then
+ *flush has to be called before the histograms are used. The FastFills belong to the set
+ *useFast was called on (sets from forThread have none)
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#ifndef HISTOSET_H
+#define HISTOSET_H
+
+#include "TROOT.h"
+#include "TH1.h"
+#include "DenseHist.h"
+#include "FastFill.h"
+#include <vector>
+
+using namespace std;
+
+class HistoSet {
+
+  public:
+    class Target {
+      public:
+        TH1 *histo;
+        DenseHist::Filler *filler; //parallel pass
+        FastFill *fast; //batched fast path
+        void Fill(Double_t x) {
+          if (filler) filler->Fill(x);
+          else if (fast) fast->Fill(x);
+          else histo->Fill(x);
+        }
+        void Fill(Double_t x, Double_t y) {
+          if (filler) filler->Fill(x, y);
+          else if (fast) fast->Fill(x, y);
+          else histo->Fill(x, y);
+        }
+    };
+
+    ~HistoSet();
+    void add(TH1 *histo);
+    void useFast();
+    void flush();
+    Target* operator[](int i) { return &targets[i]; }
+    vector<DenseHist*> makeDense(Int_t nthreads, DenseHist::Mode mode=DenseHist::AUTO);
+    HistoSet forThread(vector<DenseHist*> &dense); //call from the main thread, before filling
+    void addDense(vector<DenseHist*> &dense); //adds to the histograms and deletes the dense ones
+
+  private:
+    vector<Target> targets;
+};
+
+#endif
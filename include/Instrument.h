@@ -0,0 +1,56 @@
+/*Instrument.h
+ *Lightweight run instrumentation: scoped timers for the processing stages and named counters
+ *(events read, events passing each gate, fills, bytes written). Off by default; when off a
+ *timer or counter is a single check of a bool. Enabled with -t <file> in main, which writes a
+ *report of every stage and counter when the program is done: JSON, or CSV if the file name
+ *ends in .csv.
+ *
+ *  {
+ *    Instrument::Timer t("sort_full");   //times the enclosing scope
+ *    ...
+ *  }
+ *  Instrument::count("events_read", nentries);
+ *
+ *Timers of the same name add up (calls are counted). Stages can be timed from any thread.
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include "TROOT.h"
+#include <chrono>
+
+class Instrument {
+
+  public:
+    static void enable(const char* reportName);
+    static bool isEnabled() { return enabled; }
+    static void addTime(const char* stage, Double_t seconds);
+    static void count(const char* counter, Long64_t n=1);
+    static void report(); //writes the report file if enabled
+
+    class Timer {
+      public:
+        Timer(const char* stageName) : stage(stageName), running(enabled) {
+          if (running) start = std::chrono::steady_clock::now();
+        }
+        ~Timer() { stop(); }
+        void stop() { //end the stage before the end of the scope
+          if (!running) return;
+          running = false;
+          addTime(stage, std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count());
+        }
+
+      private:
+        const char* stage;
+        bool running;
+        std::chrono::steady_clock::time_point start;
+    };
+
+  private:
+    static bool enabled;
+};
+
+#endif
@@ -0,0 +1,55 @@
+/*OutputPolicy.h
+ *Controls how an output tree (SortTree) is written: which branches are made, whether only
+ *accepted events (passing every gate, or coincFlag set) are kept, the basket size, the cluster size
+ *(autoflush) and the compression of the output file. Read from a policy file given with -p;
+ *without one everything is written as before (all branches, all events, ROOT defaults).
+ *
+ *Policy file, one setting per line, # for comments:
+ *  branches x1 theta gateMask  (branches to write, default all)
+ *  acceptedOnly 1              (only events passing every gate or with coincFlag, default 0)
+ *  basketSize 256000           (bytes per branch basket, default 32000)
+ *  autoFlush 100000            (entries per cluster, default ROOT's 30 MB)
+ *  compression lz4 4           (zlib, lzma, lz4 or zstd and the level, default file default)
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#ifndef OUTPUTPOLICY_H
+#define OUTPUTPOLICY_H
+
+#include "TROOT.h"
+#include "TTree.h"
+#include "TFile.h"
+#include <vector>
+#include <string>
+
+using namespace std;
+
+class OutputPolicy {
+
+  public:
+    OutputPolicy();
+    bool load(const char* filename);
+    void require(const char* name); //always written, whatever the branch list says
+    void apply(TFile *file); //compression; call before the tree is made
+    void apply(TTree *tree); //cluster size
+    TBranch* branch(TTree *tree, const char* name, void *address, const char* leaflist);
+    bool accept(Int_t cutFlag, Int_t coincFlag);
+    bool isAcceptedOnly() const { return acceptedOnly; }
+    void addWriteTime(Double_t seconds); //once per stage: the tree writer's fill time, the final Write
+    void report(TTree *tree, TFile *file);
+    string signature() const; //the settings, to tell whether two policies write the same tree
+
+  private:
+    bool keep(const char* name);
+
+    vector<string> branches; //empty = all
+    bool acceptedOnly;
+    Int_t basketSize;
+    Long64_t autoFlush; //0 = ROOT default
+    Int_t algorithm, level; //algorithm -1 = file default
+    string description;
+    Double_t writeTime;
+};
+
+#endif
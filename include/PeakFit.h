@@ -3,7 +3,12 @@
  * Class to make complex fits of peaks in spectra
  * Currently can provide a fit over a determined range with a preassigned number of peaks
  * in that range. Will return a reduced chi-square value as an initial test of goodness of fit
- * Current peak shapes allowed are gaussians and breit-wigner distributions
+ * Peak shapes come from the PeakShapes registry (gaussian, breit-wigner, voigt, low tail gaussian
+ * and hypermet); any mix of them can be used in one fit
+ * Gaussian multiplets can also be found automatically (findPeaks) using the expected line width
+ * of the spectrometer, so that a fit can run without any user input
+ * Uncertainties of the peak areas, centroids and widths can be estimated by bootstrap, refitting
+ * poisson resampled copies of the histogram on several threads
  *
  * Gordon M. -- July 2019
  */
@@ -18,38 +23,95 @@
 #include <TTree.h>
 #include <TCanvas.h>
 #include <TSpectrum.h>
+#include "Math/IParamFunction.h"
+#include "Fit/Fitter.h"
+#include "PeakShapes.h"
 #include <iostream>
 #include <string>
 #include <vector>
 #include <fstream>
+#include <sstream>
+#include <thread>
+#include <chrono>
 
 using namespace std;
 
-//Class for the full function. Use a class to avoid making program global variables for 
-//number of each type of peak
+//Class for the full function: the sum of the peaks, each a shape from the PeakShapes registry with its
+//parameters stored one after the other. Use a class to avoid making program global variables for
+//the peak layout
 class MyFunc {
   public:
-    Int_t nGaussians, nBW;
-    MyFunc() {}
+    vector<const PeakShape*> shapes;
+    vector<Int_t> offsets; //index of each peak's first parameter
+    Int_t npars;
+    MyFunc() : npars(0) {}
+    void addPeak(const PeakShape *shape) {
+      shapes.push_back(shape);
+      offsets.push_back(npars);
+      npars += shape->npars;
+    }
     Double_t operator() (Double_t *x, Double_t *p) {
+      return eval(x[0], p);
+    }
+    Double_t eval(Double_t x, const Double_t *p) const {
       Double_t value=0;
-      for(int i=0; i<nGaussians; i++) {
-        value += gausFunc(x, &p[i*3]);
-      }
-      for(int i=0; i<nBW; i++) {
-        value += bwFunc(x, &p[nGaussians*3+i*2]);
+      for(unsigned int i=0; i<shapes.size(); i++) {
+        value += shapes[i]->eval(x, &p[offsets[i]]);
       }
       return value;
     }
-    Double_t gausFunc(Double_t *x, Double_t *p) {
-      Double_t arg = 0;
-      if(p[2] != 0) arg = (x[0]-p[1])/p[2];
-      return p[0]*TMath::Exp(-0.5*arg*arg);
+    //derivatives wrt every parameter; each only depends on its own peak
+    void gradient(Double_t x, const Double_t *p, Double_t *grad) const {
+      for(unsigned int i=0; i<shapes.size(); i++) {
+        shapes[i]->gradient(x, &p[offsets[i]], &grad[offsets[i]]);
+      }
+    }
+    Double_t derivative(Double_t x, const Double_t *p, Int_t ipar) const {
+      Double_t grad[PeakShapes::MAX_PARS];
+      unsigned int i = 0;
+      while(i+1<shapes.size() && offsets[i+1] <= ipar) i++;
+      shapes[i]->gradient(x, &p[offsets[i]], grad);
+      return grad[ipar-offsets[i]];
+    }
+};
+
+//Single peak of the registry as a TF1 functor, for the individual fits and drawing
+class PeakFunc {
+  public:
+    const PeakShape *shape;
+    PeakFunc(const PeakShape *s) : shape(s) {}
+    Double_t operator() (Double_t *x, Double_t *p) {
+      return shape->eval(x[0], p);
     }
-    Double_t bwFunc(Double_t *x, Double_t *p) {
-      Double_t denom = TMath::Pi()*2.0*((x[0]-p[0])*(x[0]-p[0])+p[1]*p[1]/4.0);
-      return p[1]/denom;
+};
+
+//Full function with its analytic parameter gradient, so the global fit (ROOT::Fit::Fitter)
+//doesn't need numerical derivatives
+class MyGradFunc : public ROOT::Math::IParametricGradFunctionOneDim {
+  public:
+    MyGradFunc(const MyFunc &f) : func(f), pars(f.npars, 0.0) {}
+    ROOT::Math::IBaseFunctionOneDim* Clone() const {return new MyGradFunc(*this);}
+    const double* Parameters() const {return &pars[0];}
+    void SetParameters(const double *p) {pars.assign(p, p+pars.size());}
+    unsigned int NPar() const {return pars.size();}
+    void ParameterGradient(double x, const double *p, double *grad) const {func.gradient(x, p, grad);}
+
+  private:
+    double DoEvalPar(double x, const double *p) const {return func.eval(x, p);}
+    double DoParameterDerivative(double x, const double *p, unsigned int ipar) const {
+      return func.derivative(x, p, ipar);
     }
+    MyFunc func;
+    vector<double> pars;
+};
+
+//Final values for one peak of the global fit, as written by saveResults
+struct PeakResult {
+  string name, shape;
+  Double_t amplitude;
+  Double_t centroid, centroid_err;
+  Double_t width, width_err; //sigma, except FWHM for breit-wigners
+  Double_t area, area_err; //counts
 };
 
 class PeakFit {
@@ -59,30 +121,57 @@ class PeakFit {
     ~PeakFit();
     void createFunctions();
     void getRange();
+    void setRange(Float_t min, Float_t max);
+    void setResolution(Double_t fwhm, Double_t slope);
     void getRanges();
     void bckgndRemoval();
-    void findPeaks();
+    void bckgndRemoval(Int_t iters);
+    bool findPeaks();
     bool getHisto(char* filename, char* histoname);
-    void saveResults(char* filename);
+    void saveResults(char* filename, bool append);
+    void setAreaWindow(Double_t window);
     void fitHisto();
     bool drawFit();
+    void acceptFit();
+    void bootstrap(Int_t nreplicas, Int_t nthreads);
+    bool loadSeed(char* cachename);
+    void saveSeed(char* cachename);
     
   private:
-    vector<TF1*> gaussians, breitwigners;
+    string fitTemplate();
+    Double_t lineSigma(Double_t x);
+    void estimatePeak(Float_t min, Float_t max, Double_t *g);
+    bool gradientFit(ROOT::Fit::Fitter &fitter, TH1 *h, Double_t *pars);
+    Double_t windowArea(Int_t i, const Double_t *p, Double_t *grad);
+    void peakValues(const Double_t *p, Double_t *vals);
+    void computeResults();
+    void bootstrapWorker(Int_t ithread, Int_t nthreads, Int_t nreplicas, TH1F *replica);
+    Double_t seedChisquare();
+    vector<TF1*> peakFuncs; //individual peaks
     TF1* multigaus;
     MyFunc func;
     TSpectrum *spec;
     Double_t BIN_WIDTH;
-    vector<Float_t> bw_min, bw_max;
-    vector<Float_t> g_min, g_max;
-    vector<Int_t> gaus_id, bw_id;
-    Int_t nPeaks, nBW, nGaussians, totalParams;
+    Double_t RES_FWHM, RES_SLOPE; //line width model FWHM(x) = RES_FWHM + RES_SLOPE*x
+    vector<Float_t> p_min, p_max; //range of each peak's individual fit
+    Int_t nPeaks, totalParams;
     Float_t fullMax, fullMin;
     Double_t *params;
     Double_t *new_params;
-    vector<Double_t> bw_params;
+    vector<Double_t> guesses; //user initial (mean, width) per peak, width <= 0 if none given
+    Double_t AREA_WINDOW; //areas inside +/-AREA_WINDOW widths of the centroid, 0 for the full area
     Double_t chisq, r_chisq;
+    vector<Double_t> cov; //covariance matrix of the global fit, totalParams*totalParams
+    vector<PeakResult> results;
     Int_t ndf;
+    string histoName;
+    vector<Double_t> seed; //last converged params for this histo/template, empty if none
+    Double_t SEED_RCHISQ_MAX; //seed accepted without pre-fits below this reduced chi-square
+    //bootstrap results, per peak (area, centroid, width) in the order of the peaks
+    vector<Double_t> boot_vals; //every replica's values, nreplicas*3*nPeaks
+    vector<char> boot_ok; //replica fit converged
+    vector<Double_t> boot_mean, boot_sigma, boot_corr;
+    Int_t nBoot;
     TH1F *raw_histo;
     TH1F *histo;
     TH1 *bckgnd;
@@ -0,0 +1,257 @@
+/* PeakShapes.h
+ *
+ * Registry of the peak shapes PeakFit can use. Every shape is a set of plain functions:
+ * value, derivatives wrt each parameter, closed form area and derivatives of the area, and an
+ * initial guess made from a gaussian estimate of the peak. All shapes keep the same layout for
+ * the first three parameters (size, centroid, width) so results can be reported the same way
+ *
+ *  g  gaussian             A, mean, sigma                 A = height
+ *  b  breit-wigner         N, mean, FWHM                  N = area
+ *  v  voigt                N, mean, sigma, FWHM(lorentz)  N = area
+ *  e  low tail gaussian    N, mean, sigma, tau            N = area (exponentially modified gaussian
+ *                                                         with the tail on the low side)
+ *  h  hypermet             A, mean, sigma, T, beta        gaussian of height A plus a low side
+ *                                                         skew tail of relative height T, slope beta
+ *
+ * The voigt uses the Humlicek (1982) rational approximation of the Faddeeva function, which is
+ * good to ~1e-4 and much faster than a full complex error function
+ *
+ * Gordon M. -- July 2019
+ */
+
+#ifndef PEAKSHAPES_H
+#define PEAKSHAPES_H
+
+#include <TMath.h>
+#include <complex>
+#include <string>
+
+using namespace std;
+
+struct PeakShape {
+  const char *key; //letter used for the shape in the peak template
+  const char *name;
+  const char *prefix; //prefix of the individual TF1 names
+  Int_t npars;
+  Int_t positive; //bit mask of the parameters that are held positive in fits
+  Int_t color;
+  Double_t (*eval)(Double_t x, const Double_t *p);
+  void (*gradient)(Double_t x, const Double_t *p, Double_t *grad);
+  Double_t (*area)(const Double_t *p);
+  void (*areaGradient)(const Double_t *p, Double_t *grad);
+  void (*init)(const Double_t *g, Double_t *p); //g is a gaussian estimate (height, mean, sigma)
+};
+
+namespace PeakShapes {
+
+  const Double_t SQRT2 = 1.4142135623730951;
+  const Double_t SQRT2PI = 2.5066282746310002;
+  const Double_t SQRTPI = 1.7724538509055159;
+
+  //exp(x*x)*erfc(x) for x>=0, without the overflow of doing it directly
+  inline Double_t erfcx(Double_t x) {
+    if(x < 20.0) return exp(x*x)*erfc(x);
+    Double_t x2 = x*x;
+    return (1.0-0.5/x2+0.75/(x2*x2))/(x*SQRTPI);
+  }
+
+  /* Low side tail exp(u/tau + sigma^2/(2tau^2))*erfc((u/sigma + sigma/tau)/sqrt2) where u = x-mean,
+   * which integrates to 2*tau. Written as exp(-u^2/(2sigma^2))*erfcx(b) where that is stable
+   */
+  inline Double_t tail(Double_t u, Double_t sigma, Double_t tau) {
+    Double_t b = (u/sigma+sigma/tau)/SQRT2;
+    if(b < 0) return exp(u/tau+0.5*sigma*sigma/(tau*tau))*erfc(b);
+    return exp(-0.5*u*u/(sigma*sigma))*erfcx(b);
+  }
+
+  //derivatives of tail wrt mean, sigma and tau
+  inline void tailGradient(Double_t u, Double_t sigma, Double_t tau, Double_t *grad) {
+    Double_t h = tail(u, sigma, tau);
+    Double_t g = 2.0/SQRTPI*exp(-0.5*u*u/(sigma*sigma)); //2/sqrt(pi)*exp(a-b^2)
+    grad[0] = -h/tau+g/(sigma*SQRT2);
+    grad[1] = h*sigma/(tau*tau)-g*(-u/(sigma*sigma)+1.0/tau)/SQRT2;
+    grad[2] = h*(-u/(tau*tau)-sigma*sigma/(tau*tau*tau))+g*sigma/(tau*tau*SQRT2);
+  }
+
+  //Humlicek W4 approximation of the Faddeeva function w(x+iy), y>=0
+  inline complex<Double_t> faddeeva(Double_t x, Double_t y) {
+    complex<Double_t> t(y, -x);
+    Double_t s = fabs(x)+y;
+    if(s >= 15.0) return t*0.5641896/(0.5+t*t);
+    if(s >= 5.5) {
+      complex<Double_t> u = t*t;
+      return t*(1.410474+u*0.5641896)/(0.75+u*(3.0+u));
+    }
+    if(y >= 0.195*fabs(x)-0.176) {
+      return (16.4955+t*(20.20933+t*(11.96482+t*(3.778987+t*0.5642236))))/
+             (16.4955+t*(38.82363+t*(39.27121+t*(21.69274+t*(6.699398+t)))));
+    }
+    complex<Double_t> u = t*t;
+    return exp(u)-t*(36183.31-u*(3321.9905-u*(1540.787-u*(219.0313-u*(35.76683-u*(1.320522-u*0.56419))))))/
+           (32066.6-u*(24322.84-u*(9022.228-u*(2186.181-u*(364.2191-u*(61.57037-u*(1.841439-u)))))));
+  }
+
+  /*gaussian*/
+  inline Double_t gausEval(Double_t x, const Double_t *p) {
+    Double_t arg = 0;
+    if(p[2] != 0) arg = (x-p[1])/p[2];
+    return p[0]*exp(-0.5*arg*arg);
+  }
+  inline void gausGradient(Double_t x, const Double_t *p, Double_t *grad) {
+    if(p[2] == 0) {grad[0] = 1; grad[1] = 0; grad[2] = 0; return;}
+    Double_t r = (x-p[1])/p[2];
+    Double_t e = exp(-0.5*r*r);
+    grad[0] = e;
+    grad[1] = p[0]*e*r/p[2];
+    grad[2] = p[0]*e*r*r/p[2];
+  }
+  inline Double_t gausArea(const Double_t *p) {return p[0]*fabs(p[2])*SQRT2PI;}
+  inline void gausAreaGradient(const Double_t *p, Double_t *grad) {
+    grad[0] = fabs(p[2])*SQRT2PI;
+    grad[1] = 0;
+    grad[2] = (p[2] < 0 ? -1.0 : 1.0)*p[0]*SQRT2PI;
+  }
+  inline void gausInit(const Double_t *g, Double_t *p) {p[0] = g[0]; p[1] = g[1]; p[2] = g[2];}
+
+  /*breit-wigner*/
+  inline Double_t bwEval(Double_t x, const Double_t *p) {
+    Double_t denom = TMath::Pi()*2.0*((x-p[1])*(x-p[1])+p[2]*p[2]/4.0);
+    return p[0]*p[2]/denom;
+  }
+  inline void bwGradient(Double_t x, const Double_t *p, Double_t *grad) {
+    Double_t d = (x-p[1])*(x-p[1])+p[2]*p[2]/4.0;
+    grad[0] = p[2]/(2.0*TMath::Pi()*d);
+    grad[1] = p[0]*p[2]*(x-p[1])/(TMath::Pi()*d*d);
+    grad[2] = p[0]/(2.0*TMath::Pi()*d)-p[0]*p[2]*p[2]/(4.0*TMath::Pi()*d*d);
+  }
+  inline Double_t bwArea(const Double_t *p) {return p[0];}
+  inline void bwAreaGradient(const Double_t *p, Double_t *grad) {grad[0] = 1; grad[1] = 0; grad[2] = 0;}
+  inline void bwInit(const Double_t *g, Double_t *p) {
+    p[0] = g[0]*fabs(g[2])*SQRT2PI; p[1] = g[1]; p[2] = 2.3548*fabs(g[2]);
+  }
+
+  /*voigt*/
+  inline Double_t voigtEval(Double_t x, const Double_t *p) {
+    Double_t s = fabs(p[2])*SQRT2;
+    complex<Double_t> w = faddeeva((x-p[1])/s, 0.5*fabs(p[3])/s);
+    return p[0]*w.real()/(fabs(p[2])*SQRT2PI);
+  }
+  inline void voigtGradient(Double_t x, const Double_t *p, Double_t *grad) {
+    Double_t sigma = fabs(p[2]);
+    Double_t s = sigma*SQRT2;
+    complex<Double_t> z((x-p[1])/s, 0.5*fabs(p[3])/s);
+    complex<Double_t> w = faddeeva(z.real(), z.imag());
+    complex<Double_t> dw = -2.0*z*w+complex<Double_t>(0.0, 2.0/SQRTPI); //w'(z)
+    Double_t norm = 1.0/(sigma*SQRT2PI);
+    grad[0] = w.real()*norm;
+    grad[1] = p[0]*norm*(dw*(-1.0/s)).real();
+    grad[2] = p[0]*norm*((dw*(-z/sigma)).real()-w.real()/sigma);
+    grad[3] = p[0]*norm*(dw*complex<Double_t>(0.0, 0.5/s)).real();
+  }
+  inline Double_t voigtArea(const Double_t *p) {return p[0];}
+  inline void voigtAreaGradient(const Double_t *p, Double_t *grad) {
+    grad[0] = 1; grad[1] = 0; grad[2] = 0; grad[3] = 0;
+  }
+  inline void voigtInit(const Double_t *g, Double_t *p) {
+    p[0] = g[0]*fabs(g[2])*SQRT2PI; p[1] = g[1]; p[2] = 0.8*fabs(g[2]); p[3] = 0.5*fabs(g[2]);
+  }
+
+  /*exponentially modified gaussian, tail on the low side*/
+  inline Double_t emgEval(Double_t x, const Double_t *p) {
+    return p[0]/(2.0*p[3])*tail(x-p[1], p[2], p[3]);
+  }
+  inline void emgGradient(Double_t x, const Double_t *p, Double_t *grad) {
+    Double_t dt[3];
+    Double_t h = tail(x-p[1], p[2], p[3]);
+    tailGradient(x-p[1], p[2], p[3], dt);
+    Double_t norm = 1.0/(2.0*p[3]);
+    grad[0] = h*norm;
+    grad[1] = p[0]*norm*dt[0];
+    grad[2] = p[0]*norm*dt[1];
+    grad[3] = p[0]*norm*(dt[2]-h/p[3]);
+  }
+  inline Double_t emgArea(const Double_t *p) {return p[0];}
+  inline void emgAreaGradient(const Double_t *p, Double_t *grad) {
+    grad[0] = 1; grad[1] = 0; grad[2] = 0; grad[3] = 0;
+  }
+  inline void emgInit(const Double_t *g, Double_t *p) {
+    p[0] = g[0]*fabs(g[2])*SQRT2PI; p[1] = g[1]; p[2] = fabs(g[2]); p[3] = fabs(g[2]);
+  }
+
+  /*hypermet: gaussian plus low side skew tail*/
+  inline Double_t hypermetEval(Double_t x, const Double_t *p) {
+    Double_t u = x-p[1];
+    return p[0]*(exp(-0.5*u*u/(p[2]*p[2]))+0.5*p[3]*tail(u, p[2], p[4]));
+  }
+  inline void hypermetGradient(Double_t x, const Double_t *p, Double_t *grad) {
+    Double_t u = x-p[1];
+    Double_t e = exp(-0.5*u*u/(p[2]*p[2]));
+    Double_t h = tail(u, p[2], p[4]);
+    Double_t dt[3];
+    tailGradient(u, p[2], p[4], dt);
+    grad[0] = e+0.5*p[3]*h;
+    grad[1] = p[0]*(e*u/(p[2]*p[2])+0.5*p[3]*dt[0]);
+    grad[2] = p[0]*(e*u*u/(p[2]*p[2]*p[2])+0.5*p[3]*dt[1]);
+    grad[3] = 0.5*p[0]*h;
+    grad[4] = 0.5*p[0]*p[3]*dt[2];
+  }
+  inline Double_t hypermetArea(const Double_t *p) {return p[0]*(fabs(p[2])*SQRT2PI+p[3]*p[4]);}
+  inline void hypermetAreaGradient(const Double_t *p, Double_t *grad) {
+    grad[0] = fabs(p[2])*SQRT2PI+p[3]*p[4];
+    grad[1] = 0;
+    grad[2] = (p[2] < 0 ? -1.0 : 1.0)*p[0]*SQRT2PI;
+    grad[3] = p[0]*p[4];
+    grad[4] = p[0]*p[3];
+  }
+  inline void hypermetInit(const Double_t *g, Double_t *p) {
+    p[0] = g[0]; p[1] = g[1]; p[2] = fabs(g[2]); p[3] = 0.1; p[4] = fabs(g[2]);
+  }
+
+  const Int_t MAX_PARS = 5;
+  const Int_t NSHAPES = 5;
+  const PeakShape SHAPES[NSHAPES] = {
+    {"g", "gaus", "g", 3, 0, kGreen, gausEval, gausGradient, gausArea, gausAreaGradient, gausInit},
+    {"b", "bw", "bw", 3, 1<<2, kRed, bwEval, bwGradient, bwArea, bwAreaGradient, bwInit},
+    {"v", "voigt", "v", 4, (1<<2)|(1<<3), kMagenta, voigtEval, voigtGradient, voigtArea,
+     voigtAreaGradient, voigtInit},
+    {"e", "emg", "emg", 4, (1<<2)|(1<<3), kOrange, emgEval, emgGradient, emgArea, emgAreaGradient,
+     emgInit},
+    {"h", "hypermet", "hm", 5, (1<<2)|(1<<3)|(1<<4), kCyan, hypermetEval, hypermetGradient,
+     hypermetArea, hypermetAreaGradient, hypermetInit}
+  };
+
+  //Returns the shape for a template letter, NULL if there isn't one
+  inline const PeakShape* find(const string &key) {
+    for(int i=0; i<NSHAPES; i++) {
+      if(key == SHAPES[i].key) return &SHAPES[i];
+    }
+    return NULL;
+  }
+
+  /* Area of the shape (parameters p) inside +/-window widths of its centroid, and its gradient
+   * wrt the parameters. Simpson's rule over the shape's value and analytic gradient, so it works
+   * the same way for every shape. The limits move with the centroid and width, which adds the
+   * boundary terms (Leibniz rule) to their derivatives
+   */
+  inline Double_t windowArea(const PeakShape *shape, const Double_t *p, Double_t window, Double_t *grad) {
+    const Int_t nsteps = 200;
+    Double_t lo = p[1]-window*fabs(p[2]);
+    Double_t h = 2.0*window*fabs(p[2])/nsteps;
+    Double_t area = 0, g[MAX_PARS];
+    for(int j=0; j<shape->npars; j++) grad[j] = 0;
+    for(int k=0; k<=nsteps; k++) {
+      Double_t w = (k == 0 || k == nsteps) ? 1.0 : (k%2 ? 4.0 : 2.0);
+      Double_t x = lo+k*h;
+      area += w*shape->eval(x, p);
+      shape->gradient(x, p, g);
+      for(int j=0; j<shape->npars; j++) grad[j] += w*g[j];
+    }
+    for(int j=0; j<shape->npars; j++) grad[j] *= h/3.0;
+    Double_t f_lo = shape->eval(lo, p), f_hi = shape->eval(lo+nsteps*h, p);
+    grad[1] += f_hi-f_lo;
+    grad[2] += window*(p[2] < 0 ? -1.0 : 1.0)*(f_hi+f_lo);
+    return area*h/3.0;
+  }
+}
+
+#endif
@@ -0,0 +1,50 @@
+/*RunMerge.h
+ *Merges the outputs of many runs (-M <list>, one data name per line) into the outputs of one:
+ *the histograms of every run's _histo.root and _corr.root are summed and the correctTrees are
+ *concatenated, so that the background removal (and peakfit) can be run on the sum.
+ *The histograms are summed with a parallel tree reduction: each thread (one per core, at most
+ *one per run) sums the histograms of its share of the runs, then the partial sums are added in
+ *pairs, the pairs of each step in parallel, until one is left. The correctTrees are copied basket by basket without being
+ *decompressed and compressed again ("fast" CopyEntries), on their own thread while the
+ *histograms are summed; a run compressed differently from the first one is reported and
+ *recompressed instead, so the merged tree has one compression throughout.
+ *Only histograms are merged; the cuts, corrections and checkpoints differ from run to run and
+ *are not copied.
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#ifndef RUNMERGE_H
+#define RUNMERGE_H
+
+#include "TROOT.h"
+#include "TFile.h"
+#include "TH1.h"
+#include <vector>
+#include <string>
+#include <map>
+
+using namespace std;
+
+class RunMerge {
+
+  public:
+    bool load(const char* listName);
+    bool run(char* histoName, char* corrName);
+
+  private:
+    struct Sum { //histograms by name, in the order they were first found
+      vector<TH1*> histos;
+      map<string, Int_t> index;
+    };
+    static void add(Sum &sum, TH1 *h); //takes h
+    static void add(Sum &into, Sum &from); //empties from
+    static void sumFile(const string &fileName, Sum &sum);
+    static void write(Sum &sum);
+    static void reduce(const vector<string> &files, Sum &total);
+    static Long64_t mergeTrees(const vector<string> &files, TFile *output);
+
+    vector<string> histoFiles, corrFiles;
+};
+
+#endif
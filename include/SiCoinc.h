@@ -0,0 +1,63 @@
+/*SiCoinc.h
+ *Coincidences with the silicon detectors in the scattering chamber (the si channels of the
+ *channel map, mtdc 16-31 by default).
+ *Turned on at run time with a window file (-x); without one the coincidence stage is skipped.
+ *An event is in coincidence if any of the channels falls in one of the prompt windows, and
+ *is a random if one falls in one of the random windows (away from the prompt peak). Each
+ *window is checked against all of the channels at once: the comparisons are combined with
+ *bitwise ops instead of branching, so the loop vectorizes. The randoms are subtracted from
+ *the prompt spectrum scaled by the ratio of the total window widths.
+ *
+ *Window file, one window per line in mtdc channels (exclusive bounds, like the tcheck windows),
+ *# for comments; windows of the same kind should not overlap:
+ *  prompt 2950 3050
+ *  random 3200 3400
+ *  random 2600 2800
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#ifndef SICOINC_H
+#define SICOINC_H
+
+#include "TROOT.h"
+#include "TH1.h"
+#include <vector>
+
+using namespace std;
+
+class SiCoinc {
+
+  public:
+    enum Result {PROMPT=1, RANDOM=2};
+    SiCoinc();
+    bool load(const char* filename);
+    bool isEnabled() const { return !prompt.empty(); }
+    UInt_t check(const Int_t *channels, Int_t n) const { //PROMPT and/or RANDOM for the n si channels
+      UInt_t result = 0;
+      for (unsigned int w=0; w<prompt.size(); w++) {
+        if (inWindow(channels, n, prompt[w].low, prompt[w].high)) result |= PROMPT;
+      }
+      for (unsigned int w=0; w<random.size(); w++) {
+        if (inWindow(channels, n, random[w].low, random[w].high)) result |= RANDOM;
+      }
+      return result;
+    }
+    Double_t randomScale() const; //prompt width over random width
+    void subtract(TH1 *promptHisto, TH1 *randomHisto, TH1 *result) const;
+    void print() const;
+
+  private:
+    struct Window {
+      Int_t low, high;
+    };
+    static bool inWindow(const Int_t *channels, Int_t n, Int_t low, Int_t high) {
+      Int_t hit = 0;
+      for (int i=0; i<n; i++) hit |= (channels[i] > low) & (channels[i] < high);
+      return hit;
+    }
+
+    vector<Window> prompt, random;
+};
+
+#endif
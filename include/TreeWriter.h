@@ -0,0 +1,70 @@
+/*TreeWriter.h
+ *Write-behind stage for an output tree, so that filling and compressing baskets doesn't stall
+ *the event loop. Made after all of the tree's branches exist: it takes over the branch
+ *addresses (the loop keeps setting its own variables), and Fill() just copies the current
+ *values into a record of a bounded ring. A writer thread replays the records into the tree
+ *in order and calls TTree::Fill. If ROOT's implicit multithreading is on (-j in main, it is
+ *not turned on here), full baskets are compressed in parallel by ROOT's thread pool when they
+ *are flushed. ROOT::EnableThreadSafety has to have been called (main does, at start up).
+ *The output is an ordinary TTree.
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#ifndef TREEWRITER_H
+#define TREEWRITER_H
+
+#include "TROOT.h"
+#include "TTree.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+using namespace std;
+
+class TreeWriter {
+
+  public:
+    TreeWriter(TTree *tree);
+    ~TreeWriter();
+    void Fill(); //copy the current branch values; only waits if the writer is a full ring behind
+    void sync(); //wait until everything queued is in the tree (before a checkpoint), keep going
+    void finish(); //write everything still queued; the tree can be written after this
+    Double_t fillSeconds() const { return fillTime; } //time the writer thread spent in TTree::Fill (after finish)
+
+    static const Int_t BLOCK_RECORDS = 4096;
+    static const Int_t NBLOCKS = 8;
+
+  private:
+    struct Slot {
+      char *source; //loop variable
+      char *shadow; //what the branch reads from
+      Int_t size;
+    };
+    struct Block {
+      vector<char> records;
+      Int_t n;
+    };
+
+    void pushCurrent();
+    void writeLoop();
+
+    TTree *tree;
+    vector<Slot> slots;
+    vector<char> shadows;
+    Int_t recordSize;
+    vector<Block> blocks;
+    vector<Int_t> freeRing, fullRing; //block numbers
+    Int_t freeHead, freeCount, fullHead, fullCount;
+    Int_t current; //block being filled, -1 = none
+    bool done;
+    mutex lock;
+    condition_variable freeReady, fullReady;
+    thread writer;
+    Long64_t stalls;
+    Double_t fillTime;
+};
+
+#endif
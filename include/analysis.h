@@ -8,6 +8,7 @@ Dec. 2018
 Gordon M.
 
 Revised March 2019 to run without reopening and reclosing files as shown by KGH -- Gordon M.
+Raw data is cached in a columnar file after the first read (EventCache) -- Gordon M. Aug 2019
 */
 
 #ifndef ANALYSIS_H
@@ -20,31 +21,114 @@ Revised March 2019 to run without reopening and reclosing files as shown by KGH
 #include "TCutG.h"
 #include "TTree.h"
 #include "TFile.h"
+#include "EventCache.h"
+#include "BatchQueue.h"
+#include "OutputPolicy.h"
+#include "TreeWriter.h"
+#include "CutSet.h"
+#include "HistoSet.h"
+#include "CutFlow.h"
+#include "SiCoinc.h"
+#include "ChannelMap.h"
+#include "DataSchema.h"
+#include "GateGraph.h"
+#include "Checkpoint.h"
+#include <thread>
+#include <cmath>
 
 using namespace std;
 
+const int BATCH_ENTRIES = 4096; //events per batch read ahead from the DataTree
+const int QUEUE_SLOTS = 8; //batches the reader can get ahead of the analysis
+const int GATE_BATCH = 4096; //events per evaluation of the gate predicate
+const int MONITOR_CHUNK = 100000; //most new events handled between checkpoint checks in monitor mode
+
 class analysis
 {
 
   public:
     analysis();
     ~analysis();
-    void run(char* dataName, char* storageName);
+    void loadPolicy(char* policyName);
+    void setCutFile(char* fileName);
+    void setPreview(double fraction);
+    void run(char* dataName, char* storageName, char* cacheName);
+    void monitor(char* dataName, char* storageName, char* corrName, int period);
+    void regate(char* storageName, char* gateList);
+    void setCoincidence(char* windowName);
+    void setChannelMap(char* mapName);
+    void setGateFile(char* gateName);
+    void setCheckpoint(int period);
   
   private:
+    /*histograms of each per-event step, index in its HistoSet*/
+    enum RawHisto {FP1_TSUM, FP1_TDIFF, FP1_TCHECK, FP2_TSUM, FP2_TDIFF, FP2_TCHECK, SI_TIME};
+    enum TcleanHisto {SCINT1_ANODE1, FP1_ANODE1, FP2_ANODE2, X1_X2, X1_THETA};
+    enum TimingHisto {FP1_PLASTIC_TIME, FP1_RF_SCINT_WRAPPED};
+    enum FullHisto {FP1_TDIFF_TS1A1GATE, FP1_ANODE_TS1A1GATE, FP1_TDIFF_ALL, FP1_TDIFFSUM, XDIFF, XAVG, FP1_Y, PHI,
+                    FP1_TDIFF_ALL_SITIME, FP1_TDIFF_ALL_SITIME_CLOSED, FP1_TDIFF_ALL_SIRANDOM};
+    typedef void (analysis::*StepFill)(int entry, HistoSet &h);
+
+    /*SortTree variables from the storage vectors, used by the fills and the gate columns alike so
+     *that the gates see exactly the values that are written*/
+    static Float_t calcX1(Float_t tdiff1) { return tdiff1*1/1.83; }
+    static Float_t calcX2(Float_t tdiff2) { return tdiff2*1/1.969; }
+    static Float_t calcTCheck(Float_t tsum, Float_t anode_time) { return tsum/2.0-anode_time*0.0625; }
+    static Float_t calcAngle(Float_t first, Float_t second) { return (second-first)/36.0; } //36 mm between the wires
+    static Float_t calcScintTime(Float_t scint_time) { return scint_time*0.0625; }
+    static Float_t calcRFWrapped(Int_t rf, Float_t scint_time) { return fmod(rf*0.0625-scint_time, 164.95); }
+    enum CheckpointFlag {RAW_DONE=1, TCLEAN_DONE=2}; //histograms complete at the checkpoint
+    /*raw DataTree branches, index in the schema*/
+    enum RawColumn {COL_ANODE1, COL_ANODE2, COL_SCINT1, COL_SCINT2, COL_TDIFF1, COL_TDIFF2, COL_TSUM1, COL_TSUM2,
+                    COL_MTDC, COL_ANODE1_TIME, COL_ANODE2_TIME, COL_PLASTIC_TIME};
+
     /*functions*/
     void sort_raw();
     void sort_tclean();
     void sort_full();
+    void sort_fused();
+    void fill_tclean(int entry, HistoSet &h);
+    void fill_timing(int entry, HistoSet &h);
+    void fill_full(int entry, HistoSet &h, TreeWriter *writer);
+    void fill_gated(UInt_t mask, UInt_t required, HistoSet &h);
+    void fill_coinc(const Int_t *mtdc, HistoSet &h);
+    void finishCoinc();
+    void applyCuts(CutSet &cuts);
+    void makeHistograms();
+    bool setBranches(TTree *dataTree);
+    void storeEntry();
+    void clearEvents();
+    void saveCuts(char* fileName);
+    void getCuts(CutSet &cuts);
+    void writeSortGates(TFile *storage);
+    string extraGateNames();
     int notEmpty(Int_t value);
     int TCheck1Check(Float_t value);
     int TCheck2Check(Float_t value);
     int SiTimeCheck(Int_t value);
     void Reset();
     void GetWeights();
+    void fill_raw(int entry, HistoSet &h);
+    void previewFill(HistoSet &set, StepFill fill, vector<DenseHist*> &rest, thread &background);
+    void flushFills();
+    void finishPreview(HistoSet &set, vector<DenseHist*> &rest, thread &background);
+    bool ingest(char* dataName);
+    void readBatches(BatchQueue *queue);
+    void setupCache(EventCache &cache);
+    void writeCutFlow(const char* summaryName);
+    void countGates();
+    bool buildGates(UInt_t selection);
+    void evalGates(int first);
+    bool gateColumn(const string &name, int first, int n, Float_t *out);
+    void reportGates();
+    void sortBranch(const char* name, void *address, const char* leaflist, bool existing);
+    string checkpointSettings();
+    void saveCheckpoint(int entry, TreeWriter *writer);
+    void resume(const Checkpoint::State &state);
 
     /*Tree for storing final paramters*/    
     TTree *sortTree; 
+    OutputPolicy policy;
 
     /*storage vectors, so raw file only needs opened once*/
     vector<Int_t> anode1_v,
@@ -60,7 +144,7 @@ class analysis
     anode1_time_v,
     anode2_time_v;
 
-    vector<vector<Int_t>> mtdc_v;
+    vector<Int_t> mtdc_v; //the channel map's compact row per event, event after event
     
     Float_t w1, w2;
 
@@ -78,8 +162,6 @@ class analysis
     anode1_time_d,
     anode2_time_d;
 
-    vector<Int_t> *mtdc_d;
-    
     /*new tree variables*/
     Float_t tdiff1_n,
     tdiff2_n,
@@ -100,6 +182,7 @@ class analysis
     cutFlag_n,
     coincFlag_n,
     scint1_n;
+    UInt_t gateMask_n; //bit for each gate passed, see CutFlow.h
 
     /*keep track of number of entries for loops*/
     int nentries;
@@ -120,6 +203,8 @@ class analysis
     *yavg,
     *fp1_tdiff_all_sitime,
     *fp1_tdiff_all_sitime_closed,
+    *fp1_tdiff_all_sirandom,
+    *fp1_tdiff_all_sitime_sub,
     *fp1_tcheck,
     *fp2_tcheck,
     *phi_hist;
@@ -150,6 +235,27 @@ class analysis
     Int_t max2;
     Int_t min2;
 
+    vector<Int_t> *mtdc_d;
+    DataSchema schema; //raw DataTree branches read
+    bool rawFilled; //sort_raw histograms already filled during ingest
+    char *cutName; //saved gates, NULL if none
+    int sampleStride; //preview from every sampleStride-th event, 1 = no preview
+    HistoSet rawSet, tcleanSet, timingSet, fullSet;
+    CutFlow cutflow; //gate pass counts of fill_full
+    SiCoinc sicoinc; //si coincidence windows, off unless set
+    ChannelMap channels; //mtdc channels used
+    Int_t nmtdc; //channels per event in mtdc_v
+    CutFlow::Counter *gateCount;
+    GateGraph gates; //compiled gates of fill_full or regate
+    GateGraph gateConfig; //extra gates from a gate file
+    UInt_t acceptMask; //gates required for cutFlag
+    vector<UInt_t> gateMask_v; //gate masks of the events gateFirst to gateEnd-1
+    int gateFirst, gateEnd;
+    vector<vector<Float_t> > gateColumns; //gate variables of those events
+    Checkpoint checkpoint; //of the sort loop, off unless set
+    int firstEntry; //where the sort loop starts, not 0 when resuming
+    bool tcleanFilled; //sort_tclean and timing histograms already filled
+
 } ;
 
 #endif      
@@ -4,6 +4,9 @@
  *  The base constructor gives 5 polynomials, can override to give as many as needed
  *  G.M. Feb 2019
  *  Revised March 2019 to run without reopen and closing files as shown by KGH -- G.M.
+ *  The correction is saved with the corrected data and can be reapplied event by event -- G.M. Aug 2019
+ *  The tilt and fit cuts can be kept in the cut file (-c) so a run can be corrected without drawing -- G.M. Aug 2019
+ *  The correction loop can be checkpointed and resumed (-R, see Checkpoint.h) -- G.M. Aug 2019
  */
 
 #ifndef FIT_H
@@ -18,10 +21,14 @@
 #include "TFile.h"
 #include "TTree.h"
 #include "TVectorF.h"
+#include "TVectorD.h"
+#include "Checkpoint.h"
 #include <vector>
 
 using namespace std;
 
+class TreeWriter;
+
 class fit 
 {
 
@@ -29,11 +36,20 @@ class fit
     fit(); //base constructor; 5 polynomials
     fit(int n); //override; n polynomials
     void run(char* dataName, char* fileName);
+    bool loadCorrection(char* corrName);
+    Float_t correctX(Float_t x1, Float_t theta);
+    void setCutFile(char* fileName);
+    void setCheckpoint(int period);
+    static int savedFits(char* fileName);
 
   private:
     void untilt();
     void cut();
     void correct();
+    void saveCorrection();
+    bool loadCuts(char* fileName);
+    void saveCheckpoint(int entry, TreeWriter *writer);
+    void saveCuts();
     Float_t interp(Float_t x, Float_t theta);
     
     //sets of data for fitting
@@ -52,6 +68,7 @@ class fit
     Float_t x1_d,
     theta_d;
     Int_t cutFlag_d;
+    UInt_t gateMask_d;
 
     //corrected branch variables
     Float_t x1_c,
@@ -71,6 +88,10 @@ class fit
     vector<Float_t> c; //"centers" of the polynomials
     int nfuncs; //number of polynomials
     TCanvas *c1;
+    char *cutName; //file with saved tilt/fit cuts, NULL if none
+    bool cutsLoaded;
+    Checkpoint checkpoint; //of the correction loop, off unless set
+    int firstEntry; //where the correction loop starts, not 0 when resuming
 };
 
 #endif
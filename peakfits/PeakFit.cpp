@@ -3,17 +3,26 @@
  * Class to make complex fits of peaks in spectra
  * Currently can provide a fit over a determined range with a preassigned number of peaks
  * in that range. Will return a reduced chi-square value as an initial test of goodness of fit
- * Current peak shapes allowed are gaussians and breit-wigner distributions
+ * Peak shapes come from the PeakShapes registry (gaussian, breit-wigner, voigt, low tail gaussian
+ * and hypermet); any mix of them can be used in one fit
  *
  * Gordon M. -- July 2019
  */
 
 #include "PeakFit.h"
 #include "TApplication.h"
+#include "TRandom3.h"
+#include "Fit/BinData.h"
+#include "HFitInterface.h"
+#include "Math/MinimizerOptions.h"
+#include <algorithm>
+#include <unistd.h>
 
 using namespace std;
 
-PeakFit::PeakFit() {
+PeakFit::PeakFit() :
+  RES_FWHM(1.0), RES_SLOPE(0.0), AREA_WINDOW(0.0), SEED_RCHISQ_MAX(2.0), nBoot(0)
+{
   spec = new TSpectrum();
 }
 
@@ -30,6 +39,7 @@ bool PeakFit::getHisto(char* filename, char* histoname) {
   TFile *file = new TFile(filename, "READ");
   if(file->GetListOfKeys()->Contains(histoname)) {
     raw_histo = (TH1F*) file->Get(histoname);
+    histoName = histoname;
     BIN_WIDTH = raw_histo->GetXaxis()->GetBinWidth(1);
     return true;
   } else {
@@ -54,10 +64,7 @@ void PeakFit::bckgndRemoval() {
     //Should note that too many iters ove a small range can wipe the entire spectrum
     cout<<"Enter number of iterations (more equals smoother and slower): ";
     cin>>iters;
-    bckgnd = spec->Background(raw_histo, iters);
-    histo = new TH1F("clean","clean", 1200, -300, 300);
-    histo->GetXaxis()->SetRangeUser(fullMin, fullMax);
-    histo->Add(raw_histo, bckgnd, 1, -1);
+    bckgndRemoval(iters);
     histo->Draw();
     while(c1->WaitPrimitive()) {}
     string answer;
@@ -68,26 +75,129 @@ void PeakFit::bckgndRemoval() {
   }
 }
 
-/* NOT CURRENTLY USED
- * Attempt to have TSpectrum automatically find the peaks in the histogram
- * Unfortunately, it doesnt seem to work well with peaks that are overlapping a lot
- * which kinda defeats the purpose of this whole thing
+/* Background removal with a fixed number of iterations (no canvas, for batch fitting)
+ * The clean histogram takes its binning from the raw histogram so that any spectrum can be used
  */
-void PeakFit::findPeaks() {
-  Double_t sigma = 0.5;
-  nGaussians = spec->Search(histo,sigma,"nobackgroundnoMarkov",0.05);
+void PeakFit::bckgndRemoval(Int_t iters) {
+  bckgnd = spec->Background(raw_histo, iters);
+  histo = (TH1F*) raw_histo->Clone("clean");
+  histo->Reset();
+  histo->GetXaxis()->SetRangeUser(fullMin, fullMax);
+  histo->Add(raw_histo, bckgnd, 1, -1);
+}
+
+/* Expected sigma of a peak at x from the spectrometer resolution (line width model)
+ */
+Double_t PeakFit::lineSigma(Double_t x) {
+  return fabs(RES_FWHM+RES_SLOPE*x)/2.3548;
+}
+
+void PeakFit::setResolution(Double_t fwhm, Double_t slope) {
+  RES_FWHM = fwhm;
+  RES_SLOPE = slope;
+}
+
+/* Automatically finds the gaussian peaks in the (background subtracted) fit range
+ * TSpectrum::Search on its own misses peaks that overlap a lot, so candidates come from two places:
+ * 1) a deconvolution search (SearchHighRes) using the expected line width, which separates
+ *    multiplets down to about one sigma
+ * 2) minima of the smoothed second derivative, which pick up shoulders on larger peaks
+ * Candidates closer together than half of a line width are the same peak. Each peak gets a window
+ * for its individual fit of +/-2 sigma, narrowed to the midpoint between neighbors (never less than
+ * one sigma). Sets up everything that getRanges would have for an all gaussian fit. Returns false
+ * if no peak was found in the range, in which case there is nothing to fit
+ */
+bool PeakFit::findPeaks() {
+  Int_t first = histo->GetXaxis()->FindBin(fullMin);
+  Int_t last = histo->GetXaxis()->FindBin(fullMax);
+  Int_t n = last-first+1;
+  Double_t x0 = histo->GetBinCenter(first);
+  Double_t sigma_bins = lineSigma(0.5*(fullMin+fullMax))/BIN_WIDTH;
+  if(sigma_bins < 1.0) sigma_bins = 1.0; //SearchHighRes can't go below 1 bin
+  vector<Double_t> source(n), dest(n);
+  for(int i=0; i<n; i++) {
+    Double_t y = histo->GetBinContent(first+i);
+    source[i] = y > 0 ? y : 0;
+  }
+
+  vector<Double_t> candidates;
+  Int_t nfound = spec->SearchHighRes(&source[0], &dest[0], n, sigma_bins, 2.0, kFALSE, 3, kFALSE, 3);
   Double_t *xpeaks = spec->GetPositionX();
-  for (int i=0; i<nGaussians; i++) {
-    Float_t min_i =  xpeaks[i]-2*sigma;
-    Float_t max_i = xpeaks[i]+2*sigma;
-    g_min.push_back(min_i);
-    g_max.push_back(max_i);
+  for(int i=0; i<nfound; i++) {
+    candidates.push_back(x0+xpeaks[i]*BIN_WIDTH);
+  }
+
+  //gaussian smoothing at the line width, then the discrete second derivative
+  Int_t half = (Int_t) (3*sigma_bins+0.5);
+  vector<Double_t> smooth(n, 0.0), d2(n, 0.0);
+  Double_t smax = 0;
+  for(int i=0; i<n; i++) {
+    Double_t sum = 0, norm = 0;
+    for(int j=-half; j<=half; j++) {
+      if(i+j < 0 || i+j >= n) continue;
+      Double_t w = TMath::Exp(-0.5*j*j/(sigma_bins*sigma_bins));
+      sum += w*source[i+j];
+      norm += w;
+    }
+    smooth[i] = sum/norm;
+    if(smooth[i] > smax) smax = smooth[i];
+  }
+  Double_t d2min = 0;
+  for(int i=1; i<n-1; i++) {
+    d2[i] = smooth[i-1]-2.0*smooth[i]+smooth[i+1];
+    if(d2[i] < d2min) d2min = d2[i];
+  }
+  for(int i=2; i<n-2; i++) {
+    if(d2[i] < d2[i-1] && d2[i] <= d2[i+1] && d2[i] < 0.05*d2min && smooth[i] > 0.02*smax) {
+      Double_t denom = d2[i-1]-2.0*d2[i]+d2[i+1]; //parabolic interpolation of the minimum
+      Double_t shift = denom != 0 ? 0.5*(d2[i-1]-d2[i+1])/denom : 0;
+      candidates.push_back(x0+(i+shift)*BIN_WIDTH);
+    }
+  }
+
+  //merge candidates that belong to the same peak
+  sort(candidates.begin(), candidates.end());
+  vector<Double_t> centroids;
+  for(unsigned int i=0; i<candidates.size(); ) {
+    unsigned int j = i;
+    Double_t sum = 0;
+    while(j<candidates.size() && candidates[j]-candidates[i] < 0.5*lineSigma(candidates[i])) {
+      sum += candidates[j];
+      j++;
+    }
+    Double_t c = sum/(j-i);
+    if(c > fullMin && c < fullMax) centroids.push_back(c);
+    i = j;
   }
-  params = new Double_t[nGaussians*3];
+
+  nPeaks = centroids.size();
+  if(nPeaks == 0) {
+    cout<<"No peaks found in ["<<fullMin<<", "<<fullMax<<"], nothing to fit"<<endl;
+    params = new Double_t[1];
+    new_params = new Double_t[1];
+    return false;
+  }
+  cout<<"Found "<<nPeaks<<" peaks in ["<<fullMin<<", "<<fullMax<<"]:"<<endl;
+  for(int i=0; i<nPeaks; i++) {
+    Double_t sigma = lineSigma(centroids[i]);
+    Double_t lo = 2*sigma, hi = 2*sigma;
+    if(i>0) lo = TMath::Min(lo, 0.5*(centroids[i]-centroids[i-1]));
+    if(i<nPeaks-1) hi = TMath::Min(hi, 0.5*(centroids[i+1]-centroids[i]));
+    lo = TMath::Max(lo, sigma); hi = TMath::Max(hi, sigma);
+    func.addPeak(PeakShapes::find("g"));
+    p_min.push_back(TMath::Max(centroids[i]-lo, (Double_t)fullMin));
+    p_max.push_back(TMath::Min(centroids[i]+hi, (Double_t)fullMax));
+    guesses.push_back(centroids[i]);
+    guesses.push_back(sigma);
+    cout<<"  g"<<i<<": centroid = "<<centroids[i]<<" window = ["<<p_min[i]<<", "<<p_max[i]<<"]"<<endl;
+  }
+  totalParams = func.npars;
+  params = new Double_t[totalParams];
+  return true;
 }
 
-/* NOT CURRENTLY USED
- * If using FindPeaks, no need for user to enter in range of each individual
+/* Gets the full range of the fit from the user (used with findPeaks, where there is no need for
+ * the user to enter the range of each individual peak)
  */
 void PeakFit::getRange() {
   TCanvas *c1 = new TCanvas();
@@ -102,8 +212,15 @@ void PeakFit::getRange() {
   raw_histo->GetXaxis()->SetRangeUser(fullMin, fullMax);
 }
 
+void PeakFit::setRange(Float_t min, Float_t max) {
+  fullMin = min;
+  fullMax = max;
+  raw_histo->GetXaxis()->SetRangeUser(fullMin, fullMax);
+}
+
 /* Gets the type and range of each peak (and the entire fit) from the user
- * For more complicated functions (not gaus or polN) also need initial guess of params
+ * Breit-wigners also need an initial guess of the mean and width; every other shape starts
+ * from a gaussian estimate of the peak in its range
  */
 void PeakFit::getRanges() {
   TCanvas *c1 = new TCanvas();
@@ -116,133 +233,265 @@ void PeakFit::getRanges() {
   cin>>fullMax;
   cout<<"Number of peaks: ";
   cin>>nPeaks;
-  nGaussians=0; nBW=0;
   for(int i=0; i<nPeaks; i++) {
     Double_t min_i, max_i;
     string answer;
-    cout<<"Is this a gaussian or a breit-wigner distribution?(g/b) ";
-    cin>>answer;
-    if(answer == "g") {
-      cout<<"Enter in the range for gaus"<<to_string(nGaussians)<<": "<<endl;
-      gaus_id.push_back(i);
-      nGaussians++;
-      raw_histo->Draw(); 
-      while(c1->WaitPrimitive()) {}
-      cout<<"Min = ";
-      cin>>min_i;
-      cout<<"Max = ";
-      cin>>max_i;
-      g_min.push_back(min_i);
-      g_max.push_back(max_i);
-    } else if(answer == "b") {
-      Double_t mean, width;
-      cout<<"Enter in range for breit-wigner"<<to_string(nBW)<<":"<<endl;
-      bw_id.push_back(i);
-      nBW++;
-      raw_histo->Draw(); 
-      while(c1->WaitPrimitive()) {}
-      cout<<"Min = ";
-      cin>>min_i;
-      cout<<"Max = ";
-      cin>>max_i;
+    const PeakShape *shape = NULL;
+    while(!shape) {
+      cout<<"Peak shape? gaussian, breit-wigner, voigt, low tail gaussian or hypermet (g/b/v/e/h) ";
+      cin>>answer;
+      shape = PeakShapes::find(answer);
+    }
+    cout<<"Enter in the range for "<<shape->name<<" peak "<<to_string(i)<<": "<<endl;
+    raw_histo->Draw(); 
+    while(c1->WaitPrimitive()) {}
+    cout<<"Min = ";
+    cin>>min_i;
+    cout<<"Max = ";
+    cin>>max_i;
+    Double_t mean = 0, width = 0;
+    if(answer == "b") {
       cout<<"BW requires initial parameter (mean,width) guess"<<endl;
       cout<<"Mean: ";
       cin>>mean;
       cout<<"FWHM: ";
       cin>>width;
-      bw_params.push_back(mean);
-      bw_params.push_back(width);
-      bw_min.push_back(min_i);
-      bw_max.push_back(max_i);
     }
+    func.addPeak(shape);
+    p_min.push_back(min_i);
+    p_max.push_back(max_i);
+    guesses.push_back(mean);
+    guesses.push_back(width);
   }
   c1->Close();
   raw_histo->GetXaxis()->SetRangeUser(fullMin, fullMax);//restrict range for fit
-  totalParams = nGaussians*3+nBW*2; //total Parameters is (num of type) * (params of type)
+  totalParams = func.npars; //sum of the number of parameters of each peak's shape
   params = new Double_t[totalParams];
-  //Set number of types for the global fit class
-  func.nGaussians = nGaussians;
-  func.nBW = nBW;
 }
 
-/* Creates all of the TF1's to be used later. Individuals are stored in vectors
+/* Gaussian estimate (height, mean, sigma) of the peak in [min, max] of the clean histogram, from
+ * the maximum and the first two moments of the positive bins
+ */
+void PeakFit::estimatePeak(Float_t min, Float_t max, Double_t *g) {
+  Int_t first = histo->GetXaxis()->FindBin(min);
+  Int_t last = histo->GetXaxis()->FindBin(max);
+  Double_t sum = 0, sumx = 0, sumx2 = 0, height = 0;
+  for(int bin=first; bin<=last; bin++) {
+    Double_t y = histo->GetBinContent(bin);
+    if(y <= 0) continue;
+    Double_t x = histo->GetBinCenter(bin);
+    sum += y; sumx += y*x; sumx2 += y*x*x;
+    if(y > height) height = y;
+  }
+  g[0] = height;
+  g[1] = sum > 0 ? sumx/sum : 0.5*(min+max);
+  Double_t var = sum > 0 ? sumx2/sum-g[1]*g[1] : 0;
+  g[2] = var > 0 ? sqrt(var) : 0.25*(max-min);
+}
+
+/* Creates all of the TF1's to be used later. Individuals are stored in a vector
  * To make a good estimate for the full function we need both individuals and the 
- * full function
+ * full function. Each individual starts from the shape's guess made from a gaussian estimate
+ * of its range (using the user's mean and width where given)
  */
 void PeakFit::createFunctions() {
-  for (int i=0; i<nGaussians; i++) {
-    string name = "g";
-    name += to_string(i);
+  Int_t count[PeakShapes::NSHAPES] = {0};
+  for (int i=0; i<nPeaks; i++) {
+    const PeakShape *shape = func.shapes[i];
+    Int_t is = shape-PeakShapes::SHAPES;
+    string name = shape->prefix+to_string(count[is]++);
     char name_i[name.length()+1];
     strcpy(name_i, name.c_str());
-    TF1 *gaus_i = new TF1(name_i,"gaus", g_min[i], g_max[i]);
-    gaussians.push_back(gaus_i);
-  }
-  for(int i=0; i<nBW; i++) {
-    string name = "bw"+to_string(i);
-    char n_i[name.length()+1];
-    strcpy(n_i, name.c_str());
-    TF1 *bw_i = new TF1(n_i,"TMath::BreitWigner(x,[0],[1])",bw_min[i],bw_max[i]);
-    bw_i->SetParameter(0, bw_params[i]);
-    bw_i->SetParameter(1, bw_params[i+1]);
-    breitwigners.push_back(bw_i);
+    TF1 *peak_i = new TF1(name_i, PeakFunc(shape), p_min[i], p_max[i], shape->npars);
+    Double_t g[3], p[PeakShapes::MAX_PARS];
+    estimatePeak(p_min[i], p_max[i], g);
+    shape->init(g, p);
+    if(guesses[i*2+1] > 0) {
+      p[1] = guesses[i*2];
+      p[2] = guesses[i*2+1];
+    }
+    peak_i->SetParameters(p);
+    for(int j=0; j<shape->npars; j++) {
+      if(shape->positive & (1<<j)) peak_i->SetParLimits(j, 1e-9, 1e9);
+    }
+    peakFuncs.push_back(peak_i);
   }
   multigaus = new TF1("complete_fit",func,fullMin,fullMax,totalParams);
 }
 
+/* Global fit of the full function to h, starting from (and returning in) pars. Uses ROOT::Fit::Fitter
+ * with the analytic gradient of MyGradFunc and Minuit2, with the same chi-square as TH1::Fit
+ * (bin centers, empty bins skipped). The fitter is passed in so each thread of the bootstrap has its own
+ */
+bool PeakFit::gradientFit(ROOT::Fit::Fitter &fitter, TH1 *h, Double_t *pars) {
+  ROOT::Fit::DataOptions opt;
+  ROOT::Fit::DataRange range(fullMin, fullMax);
+  ROOT::Fit::BinData data(opt, range);
+  ROOT::Fit::FillData(data, h);
+  MyGradFunc gradFunc(func);
+  gradFunc.SetParameters(pars);
+  fitter.SetFunction(gradFunc);
+  fitter.Config().SetMinimizer("Minuit2");
+  for(int i=0; i<nPeaks; i++) {
+    const PeakShape *shape = func.shapes[i];
+    for(int j=0; j<shape->npars; j++) {
+      if(shape->positive & (1<<j)) fitter.Config().ParSettings(func.offsets[i]+j).SetLimits(1e-9, 1e9);
+    }
+  }
+  if(!fitter.Fit(data)) return false;
+  const ROOT::Fit::FitResult &result = fitter.Result();
+  for(int i=0; i<totalParams; i++) pars[i] = result.Parameter(i);
+  return result.IsValid();
+}
+
 /* Fits the individual functions and then takes the resulting parameters from the 
  * individual fits and gives them to the full fit as initial parameters. Results in a
  * much stronger fit than if initial guesses are used. (This method is particularly strong for
  * gaussians and other ROOT functions since there is no need for any user guessing)
  */
 void PeakFit::fitHisto() {
-  for (int i=0; i<nGaussians; i++) {
-    histo->Fit(gaussians[i], "R0+");
-    gaussians[i]->GetParameters(&params[i*3]);
-    multigaus->SetParameter(i*3, params[i*3]);
-    multigaus->SetParameter(i*3+1, params[i*3+1]);
-    multigaus->SetParameter(i*3+2, params[i*3+2]);
-  }
-  for (int i=0; i<nBW; i++) {
-    histo->Fit(breitwigners[i], "R0+");
-    int bwi = nGaussians*3+i*2;
-    breitwigners[i]->GetParameters(&params[bwi]);
-    multigaus->SetParameter(bwi, params[bwi]);
-    multigaus->SetParameter(bwi+1, params[bwi+1]);
-  }
-  histo->Fit(multigaus, "R0+");
+  //If a previous run left converged parameters for this histogram and peak template, try
+  //them first. When they already describe the spectrum the individual fits are skipped
+  bool warm = false;
+  if(!seed.empty()) {
+    multigaus->SetParameters(&seed[0]);
+    Double_t seed_rchisq = seedChisquare();
+    cout<<"Reduced chi-square of cached parameters: "<<seed_rchisq<<endl;
+    if(seed_rchisq < SEED_RCHISQ_MAX) {
+      cout<<"Using cached parameters, skipping individual peak fits"<<endl;
+      warm = true;
+    }
+  }
+  if(warm) {
+    multigaus->GetParameters(params);
+  }
+  for (int i=0; i<nPeaks && !warm; i++) {
+    histo->Fit(peakFuncs[i], "R0+");
+    peakFuncs[i]->GetParameters(&params[func.offsets[i]]);
+  }
+  ROOT::Fit::Fitter fitter;
+  bool good = gradientFit(fitter, histo, params);
+  multigaus->SetParameters(params);
+  const ROOT::Fit::FitResult &result = fitter.Result();
+  cov.clear();
+  if(good) {
+    for(int i=0; i<totalParams; i++) {
+      for(int j=0; j<totalParams; j++) cov.push_back(result.CovMatrix(i, j));
+    }
+  } else {
+    cout<<"Warning: global fit did not converge!"<<endl;
+  }
   //Returns a reduced chi square value as an inital estimate of goodness of fit
-  chisq = multigaus->GetChisquare();
-  ndf = multigaus->GetNDF();
+  chisq = result.Chi2();
+  ndf = result.Ndf();
+  multigaus->SetChisquare(chisq);
+  multigaus->SetNDF(ndf);
   r_chisq = chisq/((Double_t)ndf);
   cout<<"Chi-Squared value for fit: "<<chisq<<endl;  
   cout<<"Degrees of freedom: "<<ndf<<endl;
   cout<<"Reduced Chi-square value: "<<r_chisq<<endl;
 }
 
+/* Reduced chi-square of the global function with its current parameters over the fit range.
+ * Same definition as the default ROOT chi-square fit (empty bins skipped, errors from bin content)
+ * so it can be compared directly to the value reported after a fit
+ */
+Double_t PeakFit::seedChisquare() {
+  Int_t first = histo->GetXaxis()->FindBin(fullMin);
+  Int_t last = histo->GetXaxis()->FindBin(fullMax);
+  Double_t sum = 0;
+  Int_t nbins = 0;
+  for(int bin=first; bin<=last; bin++) {
+    Double_t y = histo->GetBinContent(bin);
+    if(y <= 0) continue;
+    Double_t diff = y-multigaus->Eval(histo->GetBinCenter(bin));
+    sum += diff*diff/y;
+    nbins++;
+  }
+  if(nbins <= totalParams) return 1e30;
+  return sum/((Double_t)(nbins-totalParams));
+}
+
+/* Peak template used to key the fit cache: the peak shapes in the order they were entered
+ * (ie ggb is two gaussians followed by a breit-wigner)
+ */
+string PeakFit::fitTemplate() {
+  string templ = "";
+  for(int i=0; i<nPeaks; i++) templ += func.shapes[i]->key;
+  return templ;
+}
+
+/* Looks up the last converged parameters for this histogram and peak template in the cache file
+ * Each line of the cache is: histoname template nparams p0 p1 ...
+ * Returns false (and fitHisto falls back to individual fits) if there is no matching entry
+ */
+bool PeakFit::loadSeed(char* cachename) {
+  seed.clear();
+  ifstream cachefile(cachename);
+  if(!cachefile.is_open()) return false;
+  string line, templ = fitTemplate();
+  while(getline(cachefile, line)) {
+    istringstream entry(line);
+    string name, entry_templ;
+    Int_t npars;
+    if(!(entry>>name>>entry_templ>>npars)) continue;
+    if(name != histoName || entry_templ != templ || npars != totalParams) continue;
+    vector<Double_t> pars(npars);
+    bool good = true;
+    for(int i=0; i<npars; i++) {
+      if(!(entry>>pars[i])) {good = false; break;}
+    }
+    if(good) seed = pars;
+  }
+  cachefile.close();
+  if(!seed.empty()) cout<<"Found cached parameters for "<<histoName<<" ("<<templ<<")"<<endl;
+  return !seed.empty();
+}
+
+/* Stores the parameters of the accepted global fit in the cache file, replacing any
+ * previous entry for the same histogram and peak template
+ */
+void PeakFit::saveSeed(char* cachename) {
+  string templ = fitTemplate();
+  vector<string> lines;
+  ifstream oldfile(cachename);
+  string line;
+  while(oldfile.is_open() && getline(oldfile, line)) {
+    istringstream entry(line);
+    string name, entry_templ;
+    if(!(entry>>name>>entry_templ)) continue;
+    if(name == histoName && entry_templ == templ) continue;
+    lines.push_back(line);
+  }
+  oldfile.close();
+
+  ofstream cachefile(cachename);
+  if(!cachefile.is_open()) {
+    cout<<"Error when writing fit cache, could not open "<<cachename<<"!"<<endl;
+    return;
+  }
+  for(unsigned int i=0; i<lines.size(); i++) cachefile<<lines[i]<<endl;
+  cachefile<<setprecision(17)<<histoName<<" "<<templ<<" "<<totalParams;
+  for(int i=0; i<totalParams; i++) cachefile<<" "<<new_params[i];
+  cachefile<<endl;
+  cachefile.close();
+}
+
 /* Draws fit as both the single global function and the individuals with the parameters from
  * the global fit. User then has the option to either indicate desire to try the fit again or
  * to accept the current fit (to be handled by main)
  */
 bool PeakFit::drawFit() {
   TCanvas *c1 = new TCanvas();
-  new_params = new Double_t[totalParams];
-  multigaus->GetParameters(&new_params[0]);
+  acceptFit();
   histo->Draw();
   multigaus->SetLineColor(kBlue);
   multigaus->Draw("same");
-  for(int i = 0; i<nGaussians; i++) {
-    TF1 *gaus = gaussians[i];
-    gaus->SetParameters(&new_params[i*3]);
-    gaus->SetLineColor(kGreen);
-    gaus->DrawF1(fullMax, fullMin, "same");
-  }
-  for(int i=0; i<nBW; i++) {
-    TF1 *bw = breitwigners[i];
-    int bwi = nGaussians*3+i*2;
-    bw->SetParameters(&new_params[bwi]);
-    bw->SetLineColor(kRed);
-    bw->DrawF1(fullMax, fullMin, "same");
+  for(int i = 0; i<nPeaks; i++) {
+    TF1 *peak = peakFuncs[i];
+    peak->SetParameters(&new_params[func.offsets[i]]);
+    peak->SetLineColor(func.shapes[i]->color);
+    peak->DrawF1(fullMax, fullMin, "same");
   }
   while(c1->WaitPrimitive()) {}
   string answer;
@@ -261,81 +510,347 @@ bool PeakFit::drawFit() {
   }
 }
 
-//Stores the results of the fit in a txt file (chi square, params, and integrated area)
-void PeakFit::saveResults(char* filename) {
-  ofstream outfile(filename);
-  if(outfile.is_open()) {
-    outfile<<fixed<<showpoint<<setprecision(7);
-    outfile<<"Chi-square = "<<chisq<<"\t"<<"DoF = "<<ndf<<"\t"<<"Reduced chi-square = "
-           <<r_chisq<<endl;
-    outfile<<endl;
-    outfile<<setw(10)<<"Gaussian"<<"\t"<<setw(10)<<"Amplitude"<<"\t"<<setw(10)<<"Centroid"
-           <<"\t"<<setw(10)<<"Std. Dev."<<"\t"<<"Area"<<endl;
-    //Note that integrals are divided by BIN_WIDTH... Numerical integration of the functions
-    //is dependent on the bin width while a true integral wouldn't be impacted by the size
-    //of dx since it would be assumed infinitesimal
-    for(int i=0; i<nGaussians; i++) {
-      TF1 *gaus = gaussians[i];
-      gaus->SetParameters(&new_params[i*3]);
-      Double_t centroid = gaus->GetParameter(1);
-      Double_t amplitude = gaus->GetParameter(0);
-      Double_t sigma = fabs(gaus->GetParameter(2));
-      Double_t area = gaus->Integral(centroid-3*sigma, centroid+3*sigma)/BIN_WIDTH;
-      outfile<<setw(10)<<gaus->GetName()<<"\t"<<amplitude<<"\t"<<centroid<<"\t"<<sigma<<"\t"
-             <<area<<endl;
+//Takes the parameters of the global fit as the final result (done by drawFit, or directly in batch)
+void PeakFit::acceptFit() {
+  new_params = new Double_t[totalParams];
+  multigaus->GetParameters(&new_params[0]);
+}
+
+//Area of peak i (parameters p) inside the area window and its gradient, see PeakShapes::windowArea
+Double_t PeakFit::windowArea(Int_t i, const Double_t *p, Double_t *grad) {
+  return PeakShapes::windowArea(func.shapes[i], p, AREA_WINDOW, grad);
+}
+
+/* Area, centroid and width of every peak for the parameters p, three values per peak in the order
+ * of the peaks. Areas are in counts (divided by the bin width): the shape's closed form area, or the
+ * area inside the window if one is set
+ */
+void PeakFit::peakValues(const Double_t *p, Double_t *vals) {
+  Double_t grad[PeakShapes::MAX_PARS];
+  for(int i=0; i<nPeaks; i++) {
+    const Double_t *pp = &p[func.offsets[i]];
+    if(AREA_WINDOW > 0) vals[i*3] = windowArea(i, pp, grad)/BIN_WIDTH;
+    else vals[i*3] = func.shapes[i]->area(pp)/BIN_WIDTH;
+    vals[i*3+1] = pp[1];
+    vals[i*3+2] = fabs(pp[2]);
+  }
+}
+
+/* Fills results from the accepted parameters. Errors come from the covariance matrix of the
+ * global fit; for the areas the covariance is propagated through the analytic derivatives of the
+ * area with respect to the peak's parameters
+ */
+void PeakFit::computeResults() {
+  results.clear();
+  vector<Double_t> vals(3*nPeaks);
+  peakValues(new_params, &vals[0]);
+  bool hasCov = ((Int_t)cov.size() == totalParams*totalParams);
+  Int_t count[PeakShapes::NSHAPES] = {0};
+  for(int i=0; i<nPeaks; i++) {
+    const PeakShape *shape = func.shapes[i];
+    Int_t pi = func.offsets[i]; //index of the peak's first parameter
+    Double_t grad[PeakShapes::MAX_PARS]; //derivatives of the area wrt the peak's parameters
+    if(AREA_WINDOW > 0) {
+      windowArea(i, &new_params[pi], grad);
+    } else {
+      shape->areaGradient(&new_params[pi], grad);
     }
-    outfile<<endl;
-    outfile<<setw(10)<<"BreitWigner"<<"\t"<<setw(10)<<"Mean"<<"\t"<<setw(10)<<"FWHM"<<"\t"
-           <<setw(10)<<"Area"<<endl;
-    for(int i=0; i<nBW; i++) {
-      TF1 *bw = breitwigners[i];
-      int bwi = nGaussians*3+i*2;
-      bw->SetParameters(&new_params[bwi]);
-      Double_t mean = bw->GetParameter(0);
-      Double_t width = bw->GetParameter(1);
-      Double_t area = bw->Integral(mean-width, mean+width)/BIN_WIDTH;
-      outfile<<setw(10)<<bw->GetName()<<"\t"<<mean<<"\t"<<width<<"\t"<<area<<endl;
+    PeakResult r;
+    r.name = shape->prefix+to_string(count[shape-PeakShapes::SHAPES]++);
+    r.shape = shape->name;
+    r.amplitude = shape->eval(new_params[pi+1], &new_params[pi]); //height at the centroid
+    r.area = vals[i*3];
+    r.centroid = vals[i*3+1];
+    r.width = vals[i*3+2];
+    r.area_err = 0; r.centroid_err = 0; r.width_err = 0;
+    if(hasCov) {
+      Double_t var = 0;
+      for(int j=0; j<shape->npars; j++) {
+        for(int k=0; k<shape->npars; k++) {
+          var += grad[j]*grad[k]*cov[(pi+j)*totalParams+pi+k];
+        }
+      }
+      r.area_err = sqrt(fabs(var))/BIN_WIDTH;
+      r.centroid_err = sqrt(fabs(cov[(pi+1)*totalParams+pi+1]));
+      r.width_err = sqrt(fabs(cov[(pi+2)*totalParams+pi+2]));
     }
-  } else {
+    results.push_back(r);
+  }
+}
+
+void PeakFit::setAreaWindow(Double_t window) {
+  AREA_WINDOW = window;
+}
+
+/* Bootstrap estimate of the uncertainties of the accepted fit. Each replica resamples the raw
+ * counts of every bin in the fit range from a poisson distribution, subtracts the same background
+ * and refits the global function starting from the accepted parameters. Replicas are split over
+ * nthreads threads, each with its own copy of the histogram and its own TF1. Each replica has a fixed
+ * random seed so the result doesn't depend on the number of threads
+ */
+void PeakFit::bootstrap(Int_t nreplicas, Int_t nthreads) {
+  if(nthreads < 1) nthreads = 1;
+  if(nthreads > nreplicas) nthreads = nreplicas;
+  nBoot = nreplicas;
+  Int_t nvals = 3*nPeaks;
+  boot_vals.assign(nreplicas*nvals, 0.0);
+  boot_ok.assign(nreplicas, 0);
+  cout<<"Bootstrapping "<<nreplicas<<" replicas on "<<nthreads<<" threads..."<<endl;
+
+  //Minuit2 is thread safe, TMinuit is not
+  ROOT::Math::MinimizerOptions::SetDefaultMinimizer("Minuit2");
+  TH1::AddDirectory(kFALSE);
+  vector<TH1F*> replicas;
+  for(int t=0; t<nthreads; t++) {
+    replicas.push_back((TH1F*) histo->Clone(Form("replica%d", t)));
+  }
+  auto start = chrono::steady_clock::now();
+  vector<thread> workers;
+  for(int t=0; t<nthreads; t++) {
+    workers.push_back(thread(&PeakFit::bootstrapWorker, this, t, nthreads, nreplicas, replicas[t]));
+  }
+  for(unsigned int t=0; t<workers.size(); t++) workers[t].join();
+  chrono::duration<double> elapsed = chrono::steady_clock::now()-start;
+  for(int t=0; t<nthreads; t++) delete replicas[t];
+
+  //mean, standard deviation and correlation of every value over the converged replicas
+  Int_t ngood = 0;
+  boot_mean.assign(nvals, 0.0);
+  boot_sigma.assign(nvals, 0.0);
+  boot_corr.assign(nvals*nvals, 0.0);
+  for(int r=0; r<nreplicas; r++) {
+    if(!boot_ok[r]) continue;
+    ngood++;
+    for(int i=0; i<nvals; i++) boot_mean[i] += boot_vals[r*nvals+i];
+  }
+  if(ngood < 2) {
+    cout<<"Not enough converged replicas for bootstrap uncertainties!"<<endl;
+    nBoot = 0;
+    return;
+  }
+  for(int i=0; i<nvals; i++) boot_mean[i] /= ngood;
+  for(int r=0; r<nreplicas; r++) {
+    if(!boot_ok[r]) continue;
+    for(int i=0; i<nvals; i++) {
+      for(int j=0; j<nvals; j++) {
+        boot_corr[i*nvals+j] += (boot_vals[r*nvals+i]-boot_mean[i])*(boot_vals[r*nvals+j]-boot_mean[j]);
+      }
+    }
+  }
+  for(int i=0; i<nvals; i++) boot_sigma[i] = sqrt(boot_corr[i*nvals+i]/(ngood-1));
+  for(int i=0; i<nvals; i++) {
+    for(int j=0; j<nvals; j++) {
+      Double_t denom = boot_sigma[i]*boot_sigma[j]*(ngood-1);
+      boot_corr[i*nvals+j] = denom > 0 ? boot_corr[i*nvals+j]/denom : (i == j ? 1.0 : 0.0);
+    }
+  }
+  nBoot = ngood;
+  cout<<ngood<<" of "<<nreplicas<<" replicas converged, wall time "<<elapsed.count()<<" s"<<endl;
+}
+
+/* Fits every nthreads-th replica starting at ithread. Only touches its own histogram, fitter and
+ * slots of boot_vals/boot_ok, so no locking is needed
+ */
+void PeakFit::bootstrapWorker(Int_t ithread, Int_t nthreads, Int_t nreplicas, TH1F *replica) {
+  Int_t first = histo->GetXaxis()->FindBin(fullMin);
+  Int_t last = histo->GetXaxis()->FindBin(fullMax);
+  Int_t nvals = 3*nPeaks;
+  ROOT::Fit::Fitter fitter;
+  vector<Double_t> pars(totalParams);
+  for(int r=ithread; r<nreplicas; r+=nthreads) {
+    TRandom3 rng(r+1);
+    //bin errors are kept from the original histogram so each replica is weighted the same way
+    for(int bin=first; bin<=last; bin++) {
+      Double_t b = bckgnd->GetBinContent(bin);
+      Double_t raw = histo->GetBinContent(bin)+b;
+      replica->SetBinContent(bin, rng.Poisson(raw > 0 ? raw : 0)-b);
+    }
+    pars.assign(new_params, new_params+totalParams);
+    if(!gradientFit(fitter, replica, &pars[0])) continue;
+    peakValues(&pars[0], &boot_vals[r*nvals]);
+    boot_ok[r] = 1;
+  }
+}
+
+/* Stores the results of the fit in a tab separated table with one row per peak. Lines starting
+ * with # hold the fit information (histogram, range, chi-square) and, if a bootstrap was run, its
+ * correlation matrix. In append mode the rows are added to an existing file (one file for a whole
+ * batch of fits); the column header is only written when the file is new. The table is built in
+ * memory and written in one go
+ */
+void PeakFit::saveResults(char* filename, bool append) {
+  computeResults();
+  bool newfile = true;
+  if(append) {
+    ifstream oldfile(filename);
+    newfile = !oldfile.is_open() || oldfile.peek() == ifstream::traits_type::eof();
+  }
+  ofstream outfile(filename, append ? ios::app : ios::trunc);
+  if(!outfile.is_open()) {
     cout<<"Error when writing fit results to file, could not open output file!"<<endl;
+    return;
+  }
+  string out;
+  char line[512];
+  snprintf(line, sizeof(line), "# histogram %s range %.7f %.7f chisq %.7f ndf %d reduced_chisq %.7f "
+           "area_window %.7f\n", histoName.c_str(), fullMin, fullMax, chisq, ndf, r_chisq, AREA_WINDOW);
+  out += line;
+  if(newfile) {
+    out += "histo\tpeak\tshape\tamplitude\tcentroid\tcentroid_err\twidth\twidth_err\tarea\tarea_err"
+           "\tboot_area_err\tboot_centroid_err\tboot_width_err\n";
+  }
+  for(unsigned int i=0; i<results.size(); i++) {
+    const PeakResult &r = results[i];
+    Double_t boot[3] = {0, 0, 0};
+    if(nBoot > 0) {
+      for(int j=0; j<3; j++) boot[j] = boot_sigma[i*3+j];
+    }
+    snprintf(line, sizeof(line), "%s\t%s\t%s\t%.7f\t%.7f\t%.7f\t%.7f\t%.7f\t%.7f\t%.7f\t%.7f\t%.7f\t%.7f\n",
+             histoName.c_str(), r.name.c_str(), r.shape.c_str(), r.amplitude, r.centroid, r.centroid_err,
+             r.width, r.width_err, r.area, r.area_err, boot[0], boot[1], boot[2]);
+    out += line;
+  }
+  if(nBoot > 0) {
+    Int_t nvals = 3*results.size();
+    snprintf(line, sizeof(line), "# bootstrap correlation (%d replicas; area, centroid, width per peak)\n", nBoot);
+    out += line;
+    for(int i=0; i<nvals; i++) {
+      out += "#";
+      for(int j=0; j<nvals; j++) {
+        snprintf(line, sizeof(line), "\t%.4f", boot_corr[i*nvals+j]);
+        out += line;
+      }
+      out += "\n";
+    }
   }
+  outfile.write(out.c_str(), out.size());
   outfile.close();
 }
 
 /* Currently has own main which asks for 2 inputs (infile and outfile) to make it not 
  * restricted to one specific setup, but could be very easily folded into a larger analysis
  * process if desired
+ * An optional third input names a fit cache; converged parameters are stored there and used
+ * to warm start the next fit of the same histogram (ie the next run in a batch)
+ * Options:
+ *  -a           find gaussian peaks automatically instead of entering each range
+ *  -w fwhm[:s]  line width model for -a, FWHM(x) = fwhm + s*x in histogram units (default 1.0)
+ *  -n histo     name of the histogram to fit (otherwise asked for)
+ *  -R min:max   range of the fit (otherwise drawn and asked for)
+ *  -i iters     background iterations (otherwise asked for)
+ *  -W k         report areas inside +/-k sigma (gaussian) or +/-k FWHM (breit-wigner) instead
+ *               of the full area
+ *  -u n[:t]     bootstrap uncertainties from n replicas on t threads (default all cores)
+ * With -a, -n, -R and -i all given the fit runs in batch: no canvases or questions, the
+ * global fit is accepted as is, and the results are appended to the output file
  */
 int main(int argc, char **argv) {
-  if(argc == 3) {
-    TApplication *app = new TApplication("app", &argc, argv);
-    argc = app->Argc();
-    argv = app->Argv();
-    cout<<"Input file: "<<argv[1]<<" Output file: "<<argv[2]<<endl;
+  bool autofind = false;
+  string histoArg = "";
+  Float_t rangeMin = 0, rangeMax = 0;
+  bool rangeSet = false;
+  Int_t iters = 0;
+  Double_t res_fwhm = 1.0, res_slope = 0.0;
+  Double_t window = 0.0;
+  Int_t nreplicas = 0, nthreads = thread::hardware_concurrency();
+  int opt = getopt(argc, argv, "aw:n:R:i:u:W:");
+  while(opt != -1) {
+    switch(opt) {
+      case 'a':
+        autofind = true;
+        break;
+      case 'w': {
+        Double_t fwhm = res_fwhm, slope = 0;
+        if(sscanf(optarg, "%lf:%lf", &fwhm, &slope) < 1) cout<<"Bad line width "<<optarg<<endl;
+        res_fwhm = fwhm; res_slope = slope;
+        break;
+      }
+      case 'n':
+        histoArg = optarg;
+        break;
+      case 'R':
+        rangeSet = (sscanf(optarg, "%f:%f", &rangeMin, &rangeMax) == 2);
+        if(!rangeSet) cout<<"Bad range "<<optarg<<", should be min:max"<<endl;
+        break;
+      case 'i':
+        iters = atoi(optarg);
+        break;
+      case 'W':
+        window = atof(optarg);
+        break;
+      case 'u':
+        sscanf(optarg, "%d:%d", &nreplicas, &nthreads);
+        break;
+    }
+    opt = getopt(argc, argv, "aw:n:R:i:u:W:");
+  }
+  int nargs = argc-optind;
+  bool batch = autofind && histoArg != "" && rangeSet && iters > 0;
+
+  if(nargs == 2 || nargs == 3) {
+    char *infile = argv[optind], *outfile = argv[optind+1];
+    char *cachefile = nargs == 3 ? argv[optind+2] : NULL;
+    if(nreplicas > 0) ROOT::EnableThreadSafety();
+    int app_argc = 1; //keep ROOT from interpreting the peakfit options
+    TApplication *app = new TApplication("app", &app_argc, argv);
+    if(batch) gROOT->SetBatch(kTRUE);
+    cout<<"Input file: "<<infile<<" Output file: "<<outfile<<endl;
     bool goodfit = false;
+    bool useSeed = true; //cleared when a fit is rejected, so trying again doesn't start from the same seed
+    int status = 0;
     while(!goodfit) {
       PeakFit pf;
-      string answer;
-      cout<<"Enter name of histogram to be fitted: ";
-      cin>>answer;
+      string answer = histoArg;
+      if(answer == "") {
+        cout<<"Enter name of histogram to be fitted: ";
+        cin>>answer;
+      }
       char histoname[answer.length()+1];
       strcpy(histoname, answer.c_str());
-      if(pf.getHisto(argv[1], histoname)) {
-        pf.getRanges();
-        pf.bckgndRemoval();
+      if(pf.getHisto(infile, histoname)) {
+        pf.setAreaWindow(window);
+        if(autofind) {
+          pf.setResolution(res_fwhm, res_slope);
+          if(rangeSet) pf.setRange(rangeMin, rangeMax);
+          else pf.getRange();
+          if(iters > 0) pf.bckgndRemoval(iters);
+          else pf.bckgndRemoval();
+          if(!pf.findPeaks()) {
+            if(batch) {
+              status = 1;
+              break;
+            }
+            continue; //nothing saved, try another range
+          }
+        } else {
+          pf.getRanges();
+          pf.bckgndRemoval();
+        }
         pf.createFunctions();
+        if(cachefile && useSeed) pf.loadSeed(cachefile);
         pf.fitHisto();
-        goodfit = pf.drawFit();
+        if(batch) {
+          pf.acceptFit();
+          goodfit = true;
+        } else {
+          goodfit = pf.drawFit();
+          if(!goodfit) useSeed = false;
+        }
         if(goodfit) {
-          cout<<"Writing fit results to "<<argv[2]<<endl;
-          pf.saveResults(argv[2]);
+          if(nreplicas > 0) pf.bootstrap(nreplicas, nthreads);
+          cout<<"Writing fit results to "<<outfile<<endl;
+          pf.saveResults(outfile, batch);
+          if(cachefile) pf.saveSeed(cachefile);
         }
       } else {
         break;
       }
-    }  
+    }
+    delete app;
+    return status;
   } else {
     cout<<"Incorrect number of arguments! Name of input file, and of output file required!"<<endl;
+    cout<<"(Optionally followed by the name of a fit cache file)"<<endl;
     cout<<"Terminating abnormally"<<endl;
   }
   return 0;
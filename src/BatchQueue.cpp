@@ -0,0 +1,101 @@
+/*BatchQueue.cpp
+ *Bounded ring of event batches between the DataTree reader thread and the analysis.
+ *See BatchQueue.h
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#include "BatchQueue.h"
+#include <iostream>
+#include <chrono>
+
+using namespace std;
+
+BatchQueue::BatchQueue(Int_t nslots, Int_t batchEntries, Int_t nmtdc) :
+  batches(nslots), freeRing(nslots), fullRing(nslots), freeHead(0), freeCount(nslots),
+  fullHead(0), fullCount(0), done(false), nbatches(0), producerStalls(0), consumerStalls(0),
+  depthSum(0), maxDepth(0), producerWait(0), consumerWait(0)
+{
+  for(Int_t i=0; i<nslots; i++) {
+    EventBatch &b = batches[i];
+    b.n = 0;
+    b.anode1.resize(batchEntries); b.anode2.resize(batchEntries);
+    b.scint1.resize(batchEntries); b.scint2.resize(batchEntries);
+    b.tdiff1.resize(batchEntries); b.tdiff2.resize(batchEntries);
+    b.tsum1.resize(batchEntries); b.tsum2.resize(batchEntries);
+    b.scint1_time.resize(batchEntries);
+    b.anode1_time.resize(batchEntries); b.anode2_time.resize(batchEntries);
+    b.mtdc.resize(batchEntries*nmtdc);
+    freeRing[i] = &b;
+  }
+}
+
+EventBatch* BatchQueue::acquire() {
+  unique_lock<mutex> guard(lock);
+  if(freeCount == 0) {
+    producerStalls++;
+    auto start = chrono::steady_clock::now();
+    freeReady.wait(guard, [this]{return freeCount > 0;});
+    producerWait += chrono::duration<double>(chrono::steady_clock::now()-start).count();
+  }
+  EventBatch *batch = freeRing[freeHead];
+  freeHead = (freeHead+1)%freeRing.size();
+  freeCount--;
+  return batch;
+}
+
+void BatchQueue::push(EventBatch *batch) {
+  {
+    lock_guard<mutex> guard(lock);
+    fullRing[(fullHead+fullCount)%fullRing.size()] = batch;
+    fullCount++;
+    nbatches++;
+    if(fullCount > maxDepth) maxDepth = fullCount;
+  }
+  fullReady.notify_one();
+}
+
+void BatchQueue::finish() {
+  {
+    lock_guard<mutex> guard(lock);
+    done = true;
+  }
+  fullReady.notify_one();
+}
+
+EventBatch* BatchQueue::pop() {
+  unique_lock<mutex> guard(lock);
+  if(fullCount == 0 && !done) {
+    consumerStalls++;
+    auto start = chrono::steady_clock::now();
+    fullReady.wait(guard, [this]{return fullCount > 0 || done;});
+    consumerWait += chrono::duration<double>(chrono::steady_clock::now()-start).count();
+  }
+  if(fullCount == 0) return NULL; //done and drained
+  depthSum += fullCount;
+  EventBatch *batch = fullRing[fullHead];
+  fullHead = (fullHead+1)%fullRing.size();
+  fullCount--;
+  return batch;
+}
+
+void BatchQueue::release(EventBatch *batch) {
+  {
+    lock_guard<mutex> guard(lock);
+    freeRing[(freeHead+freeCount)%freeRing.size()] = batch;
+    freeCount++;
+  }
+  freeReady.notify_one();
+}
+
+/*report
+ *Prints the queue statistics; the side that waited longer is the one that was keeping up
+ */
+void BatchQueue::report() {
+  cout<<"Ingest pipeline: "<<nbatches<<" batches, mean queue depth ";
+  cout<<(nbatches ? (double)depthSum/nbatches : 0.0)<<" (max "<<maxDepth<<" of "<<batches.size()<<")"<<endl;
+  cout<<"  reader stalls (queue full): "<<producerStalls<<", "<<producerWait<<" s"<<endl;
+  cout<<"  analysis stalls (queue empty): "<<consumerStalls<<", "<<consumerWait<<" s"<<endl;
+  if(consumerWait > producerWait) cout<<"  -> I/O bound (reading/decompressing the DataTree)"<<endl;
+  else cout<<"  -> CPU bound (analysis)"<<endl;
+}
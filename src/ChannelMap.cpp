@@ -0,0 +1,97 @@
+/*ChannelMap.cpp
+ *mtdc channel roles. See ChannelMap.h for the map file format
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#include "ChannelMap.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+
+using namespace std;
+
+ChannelMap::ChannelMap() {
+  const Int_t evt2root[SI] = {1, 2, 3, 4, 9};
+  source.assign(evt2root, evt2root+SI);
+  for (Int_t ch=16; ch<32; ch++) source.push_back(ch);
+}
+
+/*load
+ *Reads a map file; returns false (and keeps the current map) if it can't be opened, has an
+ *unknown role or bad channel, or doesn't give both delay lines
+ */
+bool ChannelMap::load(const char* filename) {
+  ifstream input(filename);
+  if (!input.is_open()) {
+    cout<<"Unable to open the channel map "<<filename<<endl;
+    return false;
+  }
+  vector<Int_t> fixed(SI, -1), si;
+  bool fp1 = false, fp2 = false;
+  string line;
+  while (getline(input, line)) {
+    size_t comment = line.find('#');
+    if (comment != string::npos) line.erase(comment);
+    istringstream words(line);
+    string role, item;
+    if (!(words>>role)) continue;
+    vector<Int_t> channels;
+    while (words>>item) {
+      Int_t first, last;
+      int n = sscanf(item.c_str(), "%d-%d", &first, &last);
+      if (n == 1) last = first;
+      if (n < 1 || first < 0 || last < first) {
+        cout<<"Bad channel "<<item<<" in "<<filename<<endl;
+        return false;
+      }
+      for (Int_t ch=first; ch<=last; ch++) channels.push_back(ch);
+    }
+    unsigned int need = (role == "fp1" || role == "fp2") ? 2 : (role == "rf") ? 1 : 0;
+    if (role == "si") {
+      si.insert(si.end(), channels.begin(), channels.end());
+    } else if (need == 0) {
+      cout<<"Unknown channel role "<<role<<" in "<<filename<<" (fp1, fp2, rf or si)"<<endl;
+      return false;
+    } else if (channels.size() != need) {
+      cout<<role<<" needs "<<need<<" channel(s) in "<<filename<<endl;
+      return false;
+    } else {
+      Int_t offset = (role == "fp1") ? FP1 : (role == "fp2") ? FP2 : RF;
+      for (unsigned int i=0; i<need; i++) fixed[offset+i] = channels[i];
+      if (role == "fp1") fp1 = true;
+      if (role == "fp2") fp2 = true;
+    }
+  }
+  if (!fp1 || !fp2) {
+    cout<<"The channel map "<<filename<<" has to give the fp1 and fp2 channels"<<endl;
+    return false;
+  }
+  source = fixed;
+  source.insert(source.end(), si.begin(), si.end());
+  return true;
+}
+
+/*signature
+ *"mtdc_" and a hash of the channel list (fits the 30 characters of a cache column name)
+ */
+string ChannelMap::signature() const {
+  UInt_t hash = 2166136261u; //FNV-1a
+  for (unsigned int i=0; i<source.size(); i++) {
+    hash = (hash^(UInt_t)(source[i]+1))*16777619u;
+  }
+  char name[20];
+  snprintf(name, sizeof(name), "mtdc_%08x", hash);
+  return name;
+}
+
+void ChannelMap::print() const {
+  cout<<"Channel map: fp1 "<<source[FP1]<<" "<<source[FP1+1]<<", fp2 "<<source[FP2]<<" "<<source[FP2+1];
+  if (source[RF] >= 0) cout<<", rf "<<source[RF];
+  if (nsi() > 0) {
+    cout<<", si";
+    for (Int_t i=0; i<nsi(); i++) cout<<" "<<source[SI+i];
+  }
+  cout<<" ("<<width()<<" channels per event)"<<endl;
+}
@@ -0,0 +1,130 @@
+/*Checkpoint.cpp
+ *Checkpoint and resume of event loops. See Checkpoint.h
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#include "Checkpoint.h"
+#include "TVectorD.h"
+#include "TKey.h"
+#include <iostream>
+#include <sys/stat.h>
+
+using namespace std;
+
+Checkpoint::Checkpoint(const char* stageName) : stage(stageName), period(0) {
+  last = chrono::steady_clock::now();
+}
+
+void Checkpoint::setPeriod(Int_t seconds) {
+  period = (seconds > 0) ? seconds : 0;
+}
+
+/*setSource
+ *The input file of the loop and a description of the settings that change its results
+ */
+void Checkpoint::setSource(const char* sourceName, const string &settingsText) {
+  source = sourceName;
+  settings = settingsText;
+}
+
+bool Checkpoint::sourceInfo(Long64_t &size, Long64_t &mtime) const {
+  struct stat info;
+  if (stat(source.c_str(), &info) != 0) return false;
+  size = info.st_size;
+  mtime = info.st_mtime;
+  return true;
+}
+
+/*find
+ *Looks for a usable record of this stage in fileName; false if there is none, or (with the
+ *reason printed) if it was made from another input or with other settings, or the tree
+ *treeName doesn't have the entries it records
+ */
+bool Checkpoint::find(const char* fileName, const char* treeName, State &state) {
+  struct stat info;
+  if (stat(fileName, &info) != 0) return false;
+  TDirectory *current = gDirectory;
+  TFile *file = TFile::Open(fileName, "READ");
+  if (!file || file->IsZombie()) {
+    current->cd();
+    return false;
+  }
+  bool usable = false;
+  TVectorD *record = (TVectorD*) file->Get((stage+"_checkpoint").c_str());
+  TNamed *saved = (TNamed*) file->Get((stage+"_settings").c_str());
+  if (!record || !saved || record->GetNrows() < FIXED || (*record)[0] != VERSION) { //no checkpoint
+    file->Close();
+    current->cd();
+    return false;
+  }
+  Long64_t size, mtime;
+  if (!sourceInfo(size, mtime) || (*record)[5] != size || (*record)[6] != mtime) {
+    cout<<"The "<<stage<<" checkpoint in "<<fileName<<" is for another version of "<<source<<", starting over"<<endl;
+  } else if (settings != saved->GetTitle()) {
+    cout<<"The "<<stage<<" checkpoint in "<<fileName<<" was made with other settings ("<<saved->GetTitle()
+        <<"), starting over"<<endl;
+  } else {
+    state.cursor = (Long64_t) (*record)[1];
+    state.treeEntries = (Long64_t) (*record)[2];
+    state.flags = (UInt_t) (*record)[3];
+    state.complete = ((*record)[4] != 0);
+    state.extra.clear();
+    for (Int_t i=FIXED; i<record->GetNrows(); i++) state.extra.push_back((*record)[i]);
+    TTree *tree = (TTree*) file->Get(treeName);
+    if (!tree || tree->GetEntries() != state.treeEntries) {
+      cout<<"The "<<stage<<" checkpoint in "<<fileName<<" doesn't match its "<<treeName<<", starting over"<<endl;
+    } else {
+      usable = true;
+    }
+  }
+  file->Close();
+  current->cd();
+  return usable;
+}
+
+/*save
+ *Writes the objects (their current contents replace the saved ones), AutoSaves the tree and
+ *writes the record, then makes sure it all is on disk. objects and tree can be NULL (e.g. for
+ *the final, complete record)
+ */
+void Checkpoint::save(TFile *file, const State &state, TObjArray *objects, TTree *tree) {
+  TDirectory *current = gDirectory;
+  file->cd();
+  if (objects) objects->Write(0, TObject::kOverwrite);
+  if (tree) tree->AutoSave("SaveSelf");
+  Long64_t size = 0, mtime = 0;
+  sourceInfo(size, mtime);
+  TVectorD record(FIXED+state.extra.size());
+  record[0] = VERSION;
+  record[1] = state.cursor;
+  record[2] = state.treeEntries;
+  record[3] = state.flags;
+  record[4] = state.complete;
+  record[5] = size;
+  record[6] = mtime;
+  for (unsigned int i=0; i<state.extra.size(); i++) record[FIXED+i] = state.extra[i];
+  record.Write((stage+"_checkpoint").c_str(), TObject::kOverwrite);
+  TNamed text((stage+"_settings").c_str(), settings.c_str());
+  text.Write(0, TObject::kOverwrite);
+  file->SaveSelf(kTRUE);
+  file->Flush();
+  current->cd();
+  last = chrono::steady_clock::now();
+}
+
+/*restore
+ *Adds the contents saved in file to each of the histograms (matched by name), read from the
+ *keys so that the histograms in memory aren't picked up instead
+ */
+void Checkpoint::restore(TDirectory *file, const vector<TH1*> &histos) {
+  for (unsigned int i=0; i<histos.size(); i++) {
+    TKey *key = file->GetKey(histos[i]->GetName());
+    if (!key) continue;
+    TH1 *saved = dynamic_cast<TH1*>(key->ReadObj());
+    if (saved) {
+      histos[i]->Add(saved);
+      delete saved;
+    }
+  }
+}
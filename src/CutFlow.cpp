@@ -0,0 +1,159 @@
+/*CutFlow.cpp
+ *Gate pass counts and efficiencies. See CutFlow.h
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#include "CutFlow.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+
+using namespace std;
+
+const char* CutFlow::gateName(int gate) {
+  static const char* names[NGATES] = {"wires", "tcheck1", "tcheck2", "fp1plast_cut", "x1x2_cut", "fp1anode1_cut"};
+  return names[gate];
+}
+
+UInt_t CutFlow::parseGates(const char* list) {
+  string names = list;
+  if (names == "all") return ACCEPTED;
+  UInt_t mask = 0;
+  size_t start = 0;
+  while (start <= names.size()) {
+    size_t end = names.find(',', start);
+    if (end == string::npos) end = names.size();
+    string name = names.substr(start, end-start);
+    int g = 0;
+    while (g < NGATES && name != gateName(g)) g++;
+    if (g == NGATES) {
+      cout<<"Unknown gate "<<name<<" (gates: all";
+      for (int i=0; i<NGATES; i++) cout<<", "<<gateName(i);
+      cout<<")"<<endl;
+      return 0;
+    }
+    mask |= 1u<<g;
+    start = end+1;
+  }
+  return mask;
+}
+
+CutFlow::Counter::Counter() {
+  for (int i=0; i<(1<<NGATES); i++) counts[i] = 0;
+}
+
+CutFlow::CutFlow() {
+  for (int i=0; i<(1<<NGATES); i++) counts[i] = 0;
+}
+
+CutFlow::~CutFlow() {
+  for (unsigned int i=0; i<counters.size(); i++) delete counters[i];
+}
+
+CutFlow::Counter* CutFlow::counter() {
+  lock_guard<mutex> guard(lock);
+  Counter *c = new Counter();
+  counters.push_back(c);
+  return c;
+}
+
+void CutFlow::merge() {
+  lock_guard<mutex> guard(lock);
+  for (unsigned int i=0; i<counters.size(); i++) {
+    for (int m=0; m<(1<<NGATES); m++) {
+      counts[m] += counters[i]->counts[m];
+      counters[i]->counts[m] = 0;
+    }
+  }
+}
+
+void CutFlow::reset() {
+  lock_guard<mutex> guard(lock);
+  for (int m=0; m<(1<<NGATES); m++) counts[m] = 0;
+  for (unsigned int i=0; i<counters.size(); i++) {
+    for (int m=0; m<(1<<NGATES); m++) counters[i]->counts[m] = 0;
+  }
+}
+
+void CutFlow::addCount(UInt_t mask, Long64_t n) {
+  lock_guard<mutex> guard(lock);
+  counts[mask & ACCEPTED] += n;
+}
+
+Long64_t CutFlow::total() const {
+  Long64_t sum = 0;
+  for (int m=0; m<(1<<NGATES); m++) sum += counts[m];
+  return sum;
+}
+
+Long64_t CutFlow::passed(int gate) const {
+  Long64_t sum = 0;
+  for (int m=0; m<(1<<NGATES); m++) {
+    if (m & (1<<gate)) sum += counts[m];
+  }
+  return sum;
+}
+
+Long64_t CutFlow::through(int gate) const {
+  UInt_t need = (1u<<(gate+1))-1;
+  Long64_t sum = 0;
+  for (UInt_t m=0; m<(1u<<NGATES); m++) {
+    if ((m & need) == need) sum += counts[m];
+  }
+  return sum;
+}
+
+TH1D* CutFlow::flowHisto() {
+  TH1D *h = new TH1D("cut_flow", "events through each gate in turn", NGATES+1, 0, NGATES+1);
+  h->GetXaxis()->SetBinLabel(1, "all");
+  h->SetBinContent(1, total());
+  for (int g=0; g<NGATES; g++) {
+    h->GetXaxis()->SetBinLabel(g+2, gateName(g));
+    h->SetBinContent(g+2, through(g));
+  }
+  return h;
+}
+
+TH1D* CutFlow::passHisto() {
+  TH1D *h = new TH1D("gate_pass", "events passing each gate alone", NGATES, 0, NGATES);
+  for (int g=0; g<NGATES; g++) {
+    h->GetXaxis()->SetBinLabel(g+1, gateName(g));
+    h->SetBinContent(g+1, passed(g));
+  }
+  return h;
+}
+
+/*print
+ *One line per gate: passed alone (% of the events it is evaluated on), passed with the
+ *gates before it, efficiency relative to the gate before and to all events
+ */
+void CutFlow::print(ostream &output) {
+  Long64_t all = total(), wires = passed(WIRES);
+  output<<"Cut flow of "<<all<<" events"<<endl;
+  output<<left<<setw(16)<<"gate"<<right<<setw(14)<<"alone"<<setw(10)<<"%"
+        <<setw(14)<<"in turn"<<setw(10)<<"step %"<<setw(10)<<"total %"<<endl;
+  Long64_t before = all;
+  output<<fixed<<setprecision(2);
+  for (int g=0; g<NGATES; g++) {
+    Long64_t alone = passed(g), turn = through(g);
+    Long64_t base = (g == WIRES) ? all : wires;
+    output<<left<<setw(16)<<gateName(g)<<right<<setw(14)<<alone<<setw(10)<<(base ? 100.0*alone/base : 0.0)
+          <<setw(14)<<turn<<setw(10)<<(before ? 100.0*turn/before : 0.0)
+          <<setw(10)<<(all ? 100.0*turn/all : 0.0)<<endl;
+    before = turn;
+  }
+  output.unsetf(ios::fixed);
+  output<<setprecision(6);
+}
+
+bool CutFlow::write(const char* filename) {
+  ofstream output(filename);
+  if (!output.is_open()) {
+    cout<<"Unable to write the cut flow to "<<filename<<endl;
+    return false;
+  }
+  print(output);
+  return true;
+}
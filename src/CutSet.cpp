@@ -0,0 +1,112 @@
+/*CutSet.cpp
+ *Saving and loading the analysis gates. See CutSet.h
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#include "CutSet.h"
+#include "TFile.h"
+#include "TVectorD.h"
+#include <iostream>
+
+using namespace std;
+
+CutSet::CutSet() :
+  min1(-100000), max1(100000), min2(-100000), max2(100000), minSi(0), maxSi(0),
+  x1x2_cut(NULL), fp1anode1_cut(NULL), fp1plast_cut(NULL), fp1rfwrap_cut(NULL)
+{
+}
+
+/*load
+ *Returns false if the file doesn't exist or is missing any of the gates
+ */
+bool CutSet::load(const char* filename) {
+  TDirectory *current = gDirectory;
+  TFile *file = TFile::Open(filename, "READ");
+  if(!file || file->IsZombie()) {
+    current->cd();
+    return false;
+  }
+  bool good = load(file, filename);
+  file->Close();
+  current->cd();
+  return good;
+}
+
+/*load
+ *From a directory of an open file (label names it in messages)
+ */
+bool CutSet::load(TDirectory *dir, const char* label) {
+  TVectorD *windows = (TVectorD*) dir->Get("tcheck_windows");
+  TCutG *cuts[4];
+  const char* names[4] = {"x1x2_cut", "fp1anode1_cut", "fp1plast_cut", "fp1rfwrap_cut"};
+  bool good = (windows != NULL);
+  for(int i=0; i<4; i++) {
+    TCutG *cut = (TCutG*) dir->Get(names[i]);
+    if(!cut) {
+      cout<<"Cut file "<<label<<" has no "<<names[i]<<endl;
+      good = false;
+      cuts[i] = NULL;
+    } else {
+      cuts[i] = (TCutG*) cut->Clone(); //keep it after the file is closed
+    }
+  }
+  if(good) {
+    min1 = (*windows)[0]; max1 = (*windows)[1];
+    min2 = (*windows)[2]; max2 = (*windows)[3];
+    minSi = (*windows)[4]; maxSi = (*windows)[5];
+    x1x2_cut = cuts[0];
+    fp1anode1_cut = cuts[1];
+    fp1plast_cut = cuts[2];
+    fp1rfwrap_cut = cuts[3];
+  } else {
+    for(int i=0; i<4; i++) delete cuts[i];
+  }
+  return good;
+}
+
+bool CutSet::save(const char* filename) {
+  TDirectory *current = gDirectory;
+  TFile *file = new TFile(filename, "RECREATE");
+  if(file->IsZombie()) {
+    cout<<"Unable to save cuts to "<<filename<<endl;
+    current->cd();
+    return false;
+  }
+  write();
+  file->Close();
+  current->cd();
+  cout<<"Cuts saved to "<<filename<<endl;
+  return true;
+}
+
+void CutSet::write() {
+  writeWindows();
+  x1x2_cut->Write("x1x2_cut", TObject::kOverwrite);
+  fp1anode1_cut->Write("fp1anode1_cut", TObject::kOverwrite);
+  fp1plast_cut->Write("fp1plast_cut", TObject::kOverwrite);
+  fp1rfwrap_cut->Write("fp1rfwrap_cut", TObject::kOverwrite);
+}
+
+/*writeWindows
+ *Writes the tcheck/si windows to the current directory (the histogram file keeps them along
+ *with its cuts, so that it can be re-gated)
+ */
+void CutSet::writeWindows() {
+  TVectorD windows(6);
+  windows[0] = min1; windows[1] = max1;
+  windows[2] = min2; windows[3] = max2;
+  windows[4] = minSi; windows[5] = maxSi;
+  windows.Write("tcheck_windows", TObject::kOverwrite);
+}
+
+/*sameCut
+ *true if the two cuts have the same points
+ */
+bool CutSet::sameCut(TCutG *a, TCutG *b) {
+  if (!a || !b || a->GetN() != b->GetN()) return false;
+  for (int i=0; i<a->GetN(); i++) {
+    if (a->GetX()[i] != b->GetX()[i] || a->GetY()[i] != b->GetY()[i]) return false;
+  }
+  return true;
+}
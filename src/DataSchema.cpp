@@ -0,0 +1,117 @@
+/*DataSchema.cpp
+ *Declared raw branches, checked when the DataTree is opened. See DataSchema.h
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#include "DataSchema.h"
+#include "TLeaf.h"
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+DataSchema::DataSchema() {
+}
+
+void DataSchema::clear() {
+  columns.clear();
+}
+
+void DataSchema::add(const char* name, Int_t *var) {
+  add(name, INT, var);
+}
+
+void DataSchema::add(const char* name, Float_t *var) {
+  add(name, FLOAT, var);
+}
+
+void DataSchema::add(const char* name, vector<Int_t> **var) {
+  add(name, INT_VECTOR, var);
+}
+
+void DataSchema::add(const char* name, Type type, void *address) {
+  Column c;
+  c.name = name;
+  c.type = type;
+  c.address = address;
+  c.branch = NULL;
+  c.bulkFirst = 0;
+  c.bulkCount = (type == INT_VECTOR) ? -1 : 0;
+  columns.push_back(c);
+}
+
+const char* DataSchema::typeName(Type type) {
+  switch (type) {
+    case INT: return "Int_t";
+    case FLOAT: return "Float_t";
+    default: return "vector<int>";
+  }
+}
+
+/*open
+ *Looks up every declared branch and checks its type; only if all of them match are the other
+ *branches switched off and the declared ones bound to their variables and added to the cache
+ */
+bool DataSchema::open(TTree *tree) {
+  bool good = true;
+  for (unsigned int c=0; c<columns.size(); c++) {
+    Column &col = columns[c];
+    col.branch = tree->GetBranch(col.name.c_str());
+    if (!col.branch) {
+      cout<<"DataTree has no branch "<<col.name<<" ("<<typeName(col.type)<<")"<<endl;
+      good = false;
+      continue;
+    }
+    string found;
+    if (col.type == INT_VECTOR) {
+      found = col.branch->GetClassName();
+    } else {
+      TLeaf *leaf = col.branch->GetLeaf(col.name.c_str());
+      if (leaf && leaf->GetLen() == 1) found = leaf->GetTypeName();
+    }
+    if (found != typeName(col.type)) {
+      cout<<"DataTree branch "<<col.name<<" is "<<(found.empty() ? "not a single value" : found)
+          <<", expected "<<typeName(col.type)<<endl;
+      good = false;
+    }
+  }
+  if (!good) return false;
+
+  tree->SetBranchStatus("*", 0);
+  tree->SetCacheSize(CACHE_SIZE);
+  for (unsigned int c=0; c<columns.size(); c++) {
+    tree->SetBranchStatus(columns[c].name.c_str(), 1);
+    columns[c].branch->SetAddress(columns[c].address);
+    tree->AddBranchToCache(columns[c].name.c_str(), kTRUE);
+    columns[c].bulkCount = (columns[c].type == INT_VECTOR) ? -1 : 0; //nothing kept from another tree
+  }
+  return true;
+}
+
+/*bulkValues
+ *The deserialized value of entry in column c and the number of entries after it (itself
+ *included) in the same basket, bulk reading the basket if it isn't the one kept; NULL if the
+ *branch can't be bulk read (then it is read entry by entry from here on)
+ */
+const char* DataSchema::bulkValues(int c, Long64_t entry, Int_t &available) {
+  Column &col = columns[c];
+  if (col.bulkCount < 0) return NULL;
+  if (col.bulkCount == 0 || entry < col.bulkFirst || entry >= col.bulkFirst+col.bulkCount) {
+    Long64_t *starts = col.branch->GetBasketEntry();
+    Int_t nbaskets = col.branch->GetWriteBasket()+1;
+    Int_t basket = upper_bound(starts, starts+nbaskets, entry)-starts-1;
+    if (basket < 0) return NULL;
+    if (!col.bulk) col.bulk = make_shared<TBufferFile>(TBuffer::kWrite, 32000);
+    Int_t count = col.branch->GetBulkRead().GetBulkEntries(starts[basket], *col.bulk);
+    if (count <= 0 || entry >= starts[basket]+count) {
+      col.bulkCount = -1;
+      return NULL;
+    }
+    col.bulkFirst = starts[basket];
+    col.bulkCount = count;
+  }
+  Int_t size = (col.type == INT) ? sizeof(Int_t) : sizeof(Float_t);
+  available = col.bulkFirst+col.bulkCount-entry;
+  return col.bulk->GetCurrent()+(entry-col.bulkFirst)*size;
+}
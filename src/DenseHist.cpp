@@ -0,0 +1,126 @@
+/*DenseHist.cpp
+ *Dense histogram with sharded or atomic concurrent fills. See DenseHist.h
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#include "DenseHist.h"
+#include "TAxis.h"
+#include <cstring>
+
+using namespace std;
+
+DenseHist::DenseHist(TH1 *histo, Int_t nthreads, Mode mode) :
+  dim(histo->GetDimension()), nbinsx(histo->GetXaxis()->GetNbins()), nbinsy(0),
+  xmin(histo->GetXaxis()->GetXmin()), xmax(histo->GetXaxis()->GetXmax()), ymin(0), ymax(0)
+{
+  if (dim == 2) {
+    nbinsy = histo->GetYaxis()->GetNbins();
+    ymin = histo->GetYaxis()->GetXmin();
+    ymax = histo->GetYaxis()->GetXmax();
+    ncells = (nbinsx+2)*(nbinsy+2);
+  } else {
+    ncells = nbinsx+2;
+  }
+  if (nthreads < 1) nthreads = 1;
+  if (mode == AUTO) {
+    mode = ((Long64_t)ncells*sizeof(UInt_t)*nthreads <= SHARD_BYTES) ? SHARDED : ATOMIC;
+  }
+  fillMode = mode;
+  if (fillMode == ATOMIC) bins = vector<atomic<UInt_t>>(ncells);
+}
+
+DenseHist::~DenseHist() {
+  for (unsigned int i=0; i<fillers.size(); i++) delete fillers[i];
+}
+
+DenseHist::Mode DenseHist::GetMode() {
+  return fillMode;
+}
+
+DenseHist::Filler* DenseHist::filler() {
+  lock_guard<mutex> guard(lock);
+  Filler *f = new Filler(this);
+  fillers.push_back(f);
+  return f;
+}
+
+/*same as TAxis::FindFixBin: 0 underflow, nbins+1 overflow (and NaN)*/
+Int_t DenseHist::findBin(Double_t v, Int_t nbins, Double_t low, Double_t high) {
+  if (v < low) return 0;
+  if (!(v < high)) return nbins+1;
+  return 1+int(nbins*(v-low)/(high-low));
+}
+
+void DenseHist::count(Filler *f, Int_t bin) {
+  if (fillMode == ATOMIC) bins[bin].fetch_add(1, memory_order_relaxed);
+  else f->shard[bin]++;
+}
+
+DenseHist::Filler::Filler(DenseHist *parent) :
+  hist(parent), entries(0)
+{
+  memset(stats, 0, sizeof(stats));
+  if (hist->fillMode == SHARDED) shard.assign(hist->ncells, 0);
+}
+
+/*Fill
+ *Same bookkeeping as TH1::Fill with unit weight: every fill counts as an entry, but
+ *under/overflows don't go into the statistics
+ */
+void DenseHist::Filler::Fill(Double_t x) {
+  Int_t bin = hist->findBin(x, hist->nbinsx, hist->xmin, hist->xmax);
+  hist->count(this, bin);
+  entries++;
+  if (bin == 0 || bin > hist->nbinsx) return;
+  stats[0] += 1;
+  stats[1] += 1;
+  stats[2] += x;
+  stats[3] += x*x;
+}
+
+void DenseHist::Filler::Fill(Double_t x, Double_t y) {
+  Int_t binx = hist->findBin(x, hist->nbinsx, hist->xmin, hist->xmax);
+  Int_t biny = hist->findBin(y, hist->nbinsy, hist->ymin, hist->ymax);
+  hist->count(this, binx+(hist->nbinsx+2)*biny);
+  entries++;
+  if (binx == 0 || binx > hist->nbinsx || biny == 0 || biny > hist->nbinsy) return;
+  stats[0] += 1;
+  stats[1] += 1;
+  stats[2] += x;
+  stats[3] += x*x;
+  stats[4] += y;
+  stats[5] += y*y;
+  stats[6] += x*y;
+}
+
+/*addTo
+ *Adds the counts and statistics of every filler to histo (which must have the same binning)
+ */
+void DenseHist::addTo(TH1 *histo) {
+  vector<UInt_t> total(ncells, 0);
+  Long64_t entries = 0;
+  Double_t sums[7] = {0, 0, 0, 0, 0, 0, 0};
+  for (unsigned int f=0; f<fillers.size(); f++) {
+    if (fillMode == SHARDED) {
+      const UInt_t *shard = &fillers[f]->shard[0];
+      for (Int_t i=0; i<ncells; i++) total[i] += shard[i];
+    }
+    entries += fillers[f]->entries;
+    for (int s=0; s<7; s++) sums[s] += fillers[f]->stats[s];
+  }
+  if (fillMode == ATOMIC) {
+    for (Int_t i=0; i<ncells; i++) total[i] = bins[i].load();
+  }
+
+  Double_t stats[7];
+  histo->GetStats(stats);
+  Int_t nstats = (dim == 2) ? 7 : 4;
+  for (int s=0; s<nstats; s++) stats[s] += sums[s];
+  Double_t oldEntries = histo->GetEntries();
+  for (Int_t i=0; i<ncells; i++) {
+    if (total[i]) histo->AddBinContent(i, total[i]);
+  }
+  histo->PutStats(stats);
+  histo->SetEntries(oldEntries+entries);
+}
@@ -0,0 +1,319 @@
+/*EventCache.cpp
+ *Columnar cache of the raw event data used by the analysis, so that re-running the analysis
+ *(iterating cuts) doesn't need to read and deserialize the evt2root DataTree again.
+ *See EventCache.h for the file layout
+ *
+ *Gordon M. -- Aug 2019
+ *Reading is memory mapped and decoded in parallel over chunks -- Gordon M. Aug 2019
+ */
+
+#include "EventCache.h"
+#include "RZip.h"
+#include <iostream>
+#include <cstring>
+#include <thread>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char CACHE_MAGIC[8] = {'S','P','S','E','V','C','A','C'};
+static const UInt_t CACHE_VERSION = 2; //2: anode2_time read from its own branch
+static const Long64_t BLOCK_ALIGN = 64;
+static const Int_t ZIP_LEVEL = 1; //light and fast
+
+EventCache::EventCache() :
+  nstreams(0)
+{
+  memset(&header, 0, sizeof(header));
+}
+
+void EventCache::addColumn(const char* name, vector<Int_t> *column, Int_t width) {
+  Column col;
+  memset(&col.info, 0, sizeof(col.info));
+  col.info.type = 'I';
+  strncpy(col.info.name, name, sizeof(col.info.name)-1);
+  col.info.width = width;
+  col.data = column;
+  columns.push_back(col);
+  nstreams += width;
+}
+
+void EventCache::addColumn(const char* name, vector<Float_t> *column, Int_t width) {
+  Column col;
+  memset(&col.info, 0, sizeof(col.info));
+  col.info.type = 'F';
+  strncpy(col.info.name, name, sizeof(col.info.name)-1);
+  col.info.width = width;
+  col.data = column;
+  columns.push_back(col);
+  nstreams += width;
+}
+
+Long64_t EventCache::GetEntries() {
+  return header.nentries;
+}
+
+/*size and modification time of the raw data file, to tell if a cache is stale*/
+bool EventCache::sourceStat(const char* sourcename, Long64_t &size, Long64_t &mtime) {
+  struct stat info;
+  if(stat(sourcename, &info) != 0) return false;
+  size = info.st_size;
+  mtime = info.st_mtime;
+  return true;
+}
+
+char* EventCache::columnData(Column &col) {
+  if(col.info.type == 'I') return (char*) &(*((vector<Int_t>*) col.data))[0];
+  return (char*) &(*((vector<Float_t>*) col.data))[0];
+}
+
+void EventCache::resizeColumn(Column &col, Long64_t n) {
+  if(col.info.type == 'I') ((vector<Int_t>*) col.data)->resize(n*col.info.width);
+  else ((vector<Float_t>*) col.data)->resize(n*col.info.width);
+}
+
+/*byte shuffle: all the first bytes of the n values, then all the second bytes, etc.
+ *Makes the slowly varying high bytes into long runs that compress well
+ */
+void EventCache::shuffle(const char* in, char* out, UInt_t n) {
+  for(UInt_t i=0; i<n; i++) {
+    for(int b=0; b<4; b++) out[b*n+i] = in[i*4+b];
+  }
+}
+
+void EventCache::unshuffle(const char* in, char* out, UInt_t n) {
+  for(int b=0; b<4; b++) {
+    const char *src = &in[b*n];
+    for(UInt_t i=0; i<n; i++) out[i*4+b] = src[i];
+  }
+}
+
+/*copies channel of n events starting at first into a contiguous 4 byte array*/
+void EventCache::gather(Column &col, Int_t channel, Long64_t first, UInt_t n, char* out) {
+  const char *data = columnData(col);
+  Int_t width = col.info.width;
+  if(width == 1) {
+    memcpy(out, &data[first*4], n*4);
+    return;
+  }
+  for(UInt_t i=0; i<n; i++) memcpy(&out[i*4], &data[((first+i)*width+channel)*4], 4);
+}
+
+void EventCache::scatter(Column &col, Int_t channel, Long64_t first, UInt_t n, const char* in) {
+  char *data = columnData(col);
+  Int_t width = col.info.width;
+  if(width == 1) {
+    memcpy(&data[first*4], in, n*4);
+    return;
+  }
+  for(UInt_t i=0; i<n; i++) memcpy(&data[((first+i)*width+channel)*4], &in[i*4], 4);
+}
+
+/*write
+ *Writes the first nentries events of every registered column to filename
+ *Returns false if the file can't be written (the analysis just carries on without a cache)
+ */
+bool EventCache::write(const char* filename, const char* sourcename, Long64_t nentries) {
+  FILE *file = fopen(filename, "wb");
+  if(!file) {
+    cout<<"Warning: could not write event cache "<<filename<<endl;
+    return false;
+  }
+  memcpy(header.magic, CACHE_MAGIC, 8);
+  header.version = CACHE_VERSION;
+  header.ncolumns = columns.size();
+  header.nentries = nentries;
+  header.chunkEntries = CHUNK_ENTRIES;
+  header.nchunks = (nentries+CHUNK_ENTRIES-1)/CHUNK_ENTRIES;
+  sourceStat(sourcename, header.sourceSize, header.sourceTime);
+  index.assign(header.nchunks*nstreams, Block());
+
+  fwrite(&header, sizeof(header), 1, file);
+  for(unsigned int i=0; i<columns.size(); i++) fwrite(&columns[i].info, sizeof(ColumnInfo), 1, file);
+  Long64_t indexPos = ftell(file);
+  fwrite(&index[0], sizeof(Block), index.size(), file); //placeholder, rewritten at the end
+
+  vector<char> raw(CHUNK_ENTRIES*4), shuffled(CHUNK_ENTRIES*4), zipped(CHUNK_ENTRIES*4+512);
+  char pad[BLOCK_ALIGN] = {0};
+  Long64_t pos = ftell(file);
+  Long64_t totalRaw = 0, totalStored = 0;
+  for(UInt_t chunk=0; chunk<header.nchunks; chunk++) {
+    Long64_t first = (Long64_t)chunk*CHUNK_ENTRIES;
+    UInt_t n = (nentries-first < CHUNK_ENTRIES) ? nentries-first : CHUNK_ENTRIES;
+    Int_t stream = 0;
+    for(unsigned int c=0; c<columns.size(); c++) {
+      for(Int_t ch=0; ch<columns[c].info.width; ch++, stream++) {
+        gather(columns[c], ch, first, n, &raw[0]);
+        shuffle(&raw[0], &shuffled[0], n);
+        int srcsize = n*4, tgtsize = zipped.size(), irep = 0;
+        R__zipMultipleAlgorithm(ZIP_LEVEL, &srcsize, &shuffled[0], &tgtsize, &zipped[0], &irep,
+                                ROOT::RCompressionSetting::EAlgorithm::kLZ4);
+        Block &block = index[chunk*nstreams+stream];
+        if(pos%BLOCK_ALIGN) {
+          fwrite(pad, 1, BLOCK_ALIGN-pos%BLOCK_ALIGN, file);
+          pos += BLOCK_ALIGN-pos%BLOCK_ALIGN;
+        }
+        block.offset = pos;
+        block.rawsize = n*4;
+        if(irep > 0 && (UInt_t)irep < block.rawsize) {
+          block.zsize = irep;
+          fwrite(&zipped[0], 1, irep, file);
+        } else { //didn't compress, store the (unshuffled) values as they are
+          block.zsize = block.rawsize;
+          fwrite(&raw[0], 1, block.rawsize, file);
+        }
+        pos += block.zsize;
+        totalRaw += block.rawsize;
+        totalStored += block.zsize;
+      }
+    }
+  }
+  fseek(file, indexPos, SEEK_SET);
+  fwrite(&index[0], sizeof(Block), index.size(), file);
+  bool good = !ferror(file);
+  fclose(file);
+  if(!good) {
+    cout<<"Warning: error writing event cache "<<filename<<", removing it"<<endl;
+    remove(filename);
+    return false;
+  }
+  cout<<"Wrote event cache "<<filename<<": "<<totalStored/1048576.0<<" MB ("
+      <<totalRaw/1048576.0<<" MB uncompressed)"<<endl;
+  return true;
+}
+
+/*checks the header and column table in the mapped file against the registered columns and
+ *the raw file, and copies the chunk index
+ */
+bool EventCache::readHeader(const char* map, size_t size, const char* sourcename) {
+  if(size < sizeof(header)) return false;
+  memcpy(&header, map, sizeof(header));
+  if(memcmp(header.magic, CACHE_MAGIC, 8) != 0 || header.version != CACHE_VERSION ||
+     header.chunkEntries != CHUNK_ENTRIES) return false;
+  Long64_t srcsize = 0, mtime = 0;
+  if(!sourceStat(sourcename, srcsize, mtime) || srcsize != header.sourceSize || mtime != header.sourceTime) {
+    cout<<"Event cache is out of date with "<<sourcename<<endl;
+    return false;
+  }
+  if(header.ncolumns != columns.size()) return false;
+  size_t pos = sizeof(header);
+  if(size < pos+columns.size()*sizeof(ColumnInfo)) return false;
+  for(unsigned int i=0; i<columns.size(); i++, pos += sizeof(ColumnInfo)) {
+    ColumnInfo info;
+    memcpy(&info, &map[pos], sizeof(info));
+    if(info.type != columns[i].info.type || info.width != columns[i].info.width ||
+       strncmp(info.name, columns[i].info.name, sizeof(info.name)) != 0) return false;
+  }
+  index.resize(header.nchunks*nstreams);
+  if(size < pos+index.size()*sizeof(Block)) return false;
+  if(!index.empty()) memcpy(&index[0], &map[pos], index.size()*sizeof(Block));
+  for(unsigned int i=0; i<index.size(); i++) {
+    if(index[i].offset < 0 || (size_t)index[i].offset+index[i].zsize > size ||
+       index[i].rawsize > CHUNK_ENTRIES*4) return false;
+  }
+  return true;
+}
+
+/*decodeChunks
+ *Worker for read: decodes chunks [firstChunk, lastChunk) straight from the mapped file into
+ *the columns. Workers get disjoint event ranges, so they never write the same memory.
+ *Raw blocks of single-value columns are copied directly from the mapping, and compressed
+ *single-value blocks are unshuffled directly into the column (no intermediate copy)
+ */
+void EventCache::decodeChunks(const char* map, UInt_t firstChunk, UInt_t lastChunk, bool *good) {
+  vector<char> raw(CHUNK_ENTRIES*4), values(CHUNK_ENTRIES*4);
+  for(UInt_t chunk=firstChunk; chunk<lastChunk; chunk++) {
+    Long64_t first = (Long64_t)chunk*header.chunkEntries;
+    Int_t stream = 0;
+    for(unsigned int c=0; c<columns.size(); c++) {
+      Column &col = columns[c];
+      for(Int_t ch=0; ch<col.info.width; ch++, stream++) {
+        Block &block = index[chunk*nstreams+stream];
+        UInt_t n = block.rawsize/4;
+        const char *stored = &map[block.offset];
+        if(block.zsize == block.rawsize) {
+          scatter(col, ch, first, n, stored);
+          continue;
+        }
+        int srcsize = block.zsize, tgtsize = block.rawsize, irep = 0;
+        R__unzip(&srcsize, (unsigned char*) stored, &tgtsize, (unsigned char*) &raw[0], &irep);
+        if((UInt_t)irep != block.rawsize) {
+          *good = false;
+          return;
+        }
+        if(col.info.width == 1) {
+          unshuffle(&raw[0], &columnData(col)[first*4], n);
+        } else {
+          unshuffle(&raw[0], &values[0], n);
+          scatter(col, ch, first, n, &values[0]);
+        }
+      }
+    }
+  }
+}
+
+/*read
+ *Fills every registered column from filename. Returns false, leaving the columns empty,
+ *if there is no usable cache for sourcename (then the raw file has to be read)
+ *The file is memory mapped and the chunks are split into contiguous ranges, one per thread
+ *(nthreads=0 uses every core). The kernel is told the access is sequential, so each thread's
+ *range is read ahead while it is being decoded
+ */
+bool EventCache::read(const char* filename, const char* sourcename, Int_t nthreads) {
+  int fd = open(filename, O_RDONLY);
+  if(fd < 0) return false;
+  struct stat info;
+  if(fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  size_t size = info.st_size;
+  void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); //the mapping keeps the file open
+  if(mapping == MAP_FAILED) return false;
+  const char *map = (const char*) mapping;
+
+  if(!readHeader(map, size, sourcename)) {
+    munmap(mapping, size);
+    header.nentries = 0;
+    return false;
+  }
+  madvise(mapping, size, MADV_SEQUENTIAL);
+  madvise(mapping, size, MADV_WILLNEED);
+  for(unsigned int c=0; c<columns.size(); c++) resizeColumn(columns[c], header.nentries);
+
+  if(nthreads <= 0) nthreads = thread::hardware_concurrency();
+  if(nthreads <= 0) nthreads = 1;
+  if((UInt_t)nthreads > header.nchunks) nthreads = header.nchunks;
+  bool good = true;
+  if(nthreads <= 1) {
+    decodeChunks(map, 0, header.nchunks, &good);
+  } else {
+    vector<thread> workers;
+    vector<char> ok(nthreads, 1); //not vector<bool>, each worker needs its own byte
+    for(Int_t t=0; t<nthreads; t++) {
+      UInt_t firstChunk = (UInt_t)((ULong64_t)header.nchunks*t/nthreads);
+      UInt_t lastChunk = (UInt_t)((ULong64_t)header.nchunks*(t+1)/nthreads);
+      workers.push_back(thread([this, map, firstChunk, lastChunk, &ok, t]() {
+        bool workerGood = true;
+        decodeChunks(map, firstChunk, lastChunk, &workerGood);
+        ok[t] = workerGood;
+      }));
+    }
+    for(unsigned int t=0; t<workers.size(); t++) {
+      workers[t].join();
+      if(!ok[t]) good = false;
+    }
+  }
+  munmap(mapping, size);
+  if(!good) {
+    cout<<"Warning: event cache "<<filename<<" is corrupt, ignoring it"<<endl;
+    for(unsigned int c=0; c<columns.size(); c++) resizeColumn(columns[c], 0);
+    header.nentries = 0;
+    return false;
+  }
+  return true;
+}
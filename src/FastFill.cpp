@@ -0,0 +1,87 @@
+/*FastFill.cpp
+ *Batched fixed-binning fill path. See FastFill.h
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#include "FastFill.h"
+#include "TH2.h"
+#include "TAxis.h"
+
+void FastFill::Axis::set(TAxis *axis) {
+  nbins = axis->GetNbins();
+  low = axis->GetXmin();
+  high = axis->GetXmax();
+  inv = nbins/(high-low);
+}
+
+FastFill::FastFill(TH1 *histo) :
+  hist(histo), array(NULL), dim(histo->GetDimension()), n(0)
+{
+  ax.set(histo->GetXaxis());
+  if (dim == 2) ay.set(histo->GetYaxis());
+  bool fixed = !histo->GetXaxis()->IsVariableBinSize() && (dim == 1 || !histo->GetYaxis()->IsVariableBinSize());
+  if (!fixed || histo->GetSumw2N() > 0) return;
+  if (dim == 1 && dynamic_cast<TH1F*>(histo)) array = ((TH1F*) histo)->GetArray();
+  else if (dim == 2 && dynamic_cast<TH2F*>(histo)) array = ((TH2F*) histo)->GetArray();
+}
+
+/*flush
+ *Puts the stored values into the histogram
+ */
+void FastFill::flush() {
+  if (n == 0) return;
+  if (!array) {
+    for (Int_t i=0; i<n; i++) {
+      if (dim == 2) hist->Fill(xs[i], ys[i]);
+      else hist->Fill(xs[i]);
+    }
+    n = 0;
+    return;
+  }
+
+  Double_t stats[7];
+  hist->GetStats(stats); //before touching the array: ROOT recomputes empty stats from the bins
+  Double_t sumw = 0, sumwx = 0, sumwx2 = 0, sumwy = 0, sumwy2 = 0, sumwxy = 0;
+  if (dim == 1) {
+    for (Int_t i=0; i<n; i++) bins[i] = ax.bin(xs[i]);
+    for (Int_t i=0; i<n; i++) array[bins[i]] += 1;
+    for (Int_t i=0; i<n; i++) {
+      Double_t w = (bins[i] > 0 && bins[i] <= ax.nbins); //under/overflow stay out of the stats
+      Double_t x = w ? xs[i] : 0; //selected, not multiplied: 0*inf or 0*nan would be nan
+      sumw += w;
+      sumwx += x;
+      sumwx2 += x*x;
+    }
+  } else {
+    const Int_t stride = ax.nbins+2;
+    for (Int_t i=0; i<n; i++) {
+      Int_t bx = ax.bin(xs[i]), by = ay.bin(ys[i]);
+      bins[i] = (bx > 0 && bx <= ax.nbins && by > 0 && by <= ay.nbins) ? bx+stride*by : -(bx+stride*by)-1;
+    }
+    for (Int_t i=0; i<n; i++) array[bins[i] >= 0 ? bins[i] : -bins[i]-1] += 1;
+    for (Int_t i=0; i<n; i++) {
+      Double_t w = (bins[i] >= 0);
+      Double_t x = w ? xs[i] : 0, y = w ? ys[i] : 0;
+      sumw += w;
+      sumwx += x;
+      sumwx2 += x*x;
+      sumwy += y;
+      sumwy2 += y*y;
+      sumwxy += x*y;
+    }
+  }
+  stats[0] += sumw;
+  stats[1] += sumw;
+  stats[2] += sumwx;
+  stats[3] += sumwx2;
+  if (dim == 2) {
+    stats[4] += sumwy;
+    stats[5] += sumwy2;
+    stats[6] += sumwxy;
+  }
+  Double_t entries = hist->GetEntries();
+  hist->PutStats(stats);
+  hist->SetEntries(entries+n);
+  n = 0;
+}
@@ -0,0 +1,363 @@
+/*GateGraph.cpp
+ *Gate graph and its compiled predicate. See GateGraph.h for the gate file format
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#include "GateGraph.h"
+#include "Instrument.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+
+using namespace std;
+
+GateGraph::GateGraph() : compiled(0) {
+}
+
+void GateGraph::clear() {
+  nodes.clear();
+  ops.clear();
+  vars.clear();
+  compiled = 0;
+}
+
+void GateGraph::addWindow(const char* name, const char* var, Float_t low, Float_t high) {
+  Node n;
+  n.name = name; n.kind = WINDOW; n.varX = var; n.low = low; n.high = high; n.bit = -1; n.require = false;
+  nodes.push_back(n);
+}
+
+void GateGraph::addNotEmpty(const char* name, const char* var) {
+  Node n;
+  n.name = name; n.kind = NOTEMPTY; n.varX = var; n.low = 0; n.high = 0; n.bit = -1; n.require = false;
+  nodes.push_back(n);
+}
+
+void GateGraph::addCut(const char* name, const char* varX, const char* varY, const TCutG *cut) {
+  vector<Double_t> x, y;
+  if (cut && cut->GetN() > 0) {
+    x.assign(cut->GetX(), cut->GetX()+cut->GetN());
+    y.assign(cut->GetY(), cut->GetY()+cut->GetN());
+  }
+  addCut(name, varX, varY, x, y);
+}
+
+void GateGraph::addCut(const char* name, const char* varX, const char* varY, const vector<Double_t> &x, const vector<Double_t> &y) {
+  Node n;
+  n.name = name; n.kind = CUT; n.varX = varX; n.varY = varY; n.low = 0; n.high = 0; n.bit = -1; n.require = false;
+  n.x = x; n.y = y;
+  nodes.push_back(n);
+}
+
+void GateGraph::addAll(const char* name) {
+  Node n;
+  n.name = name; n.kind = ALL; n.low = 0; n.high = 0; n.bit = -1; n.require = false;
+  nodes.push_back(n);
+}
+
+void GateGraph::need(const char* name, const char* other) {
+  Int_t k = find(name);
+  if (k >= 0) nodes[k].needs.push_back(other);
+}
+
+void GateGraph::setBit(const char* name, Int_t bit) {
+  Int_t k = find(name);
+  if (k >= 0) nodes[k].bit = bit;
+}
+
+Int_t GateGraph::find(const string &name) const {
+  for (unsigned int k=0; k<nodes.size(); k++) {
+    if (nodes[k].name == name) return k;
+  }
+  return -1;
+}
+
+static bool number(const string &word, Double_t &value) {
+  char *end;
+  value = strtod(word.c_str(), &end);
+  return !word.empty() && *end == '\0';
+}
+
+/*load
+ *Reads a gate file, the gates getting bits from firstBit on; returns false (and leaves the
+ *graph as it was) if it can't be opened or has a bad line
+ */
+bool GateGraph::load(const char* filename, Int_t firstBit) {
+  ifstream input(filename);
+  if (!input.is_open()) {
+    cout<<"Unable to open the gate file "<<filename<<endl;
+    return false;
+  }
+  GateGraph g;
+  vector<string> required;
+  string line;
+  while (getline(input, line)) {
+    size_t comment = line.find('#');
+    if (comment != string::npos) line.erase(comment);
+    istringstream words(line);
+    vector<string> args, needs;
+    string word;
+    bool needing = false;
+    while (words>>word) {
+      if (word == "needs") needing = true;
+      else if (needing) needs.push_back(word);
+      else args.push_back(word);
+    }
+    if (args.empty()) continue;
+    const string &kind = args[0];
+    if (kind == "require") {
+      required.insert(required.end(), args.begin()+1, args.end());
+      continue;
+    }
+    if (args.size() >= 2 && g.find(args[1]) >= 0) {
+      cout<<"Gate "<<args[1]<<" is declared twice in "<<filename<<endl;
+      return false;
+    }
+    bool good;
+    Double_t low, high;
+    if (kind == "window") {
+      good = args.size() == 5 && number(args[3], low) && number(args[4], high) && low < high;
+      if (good) g.addWindow(args[1].c_str(), args[2].c_str(), low, high);
+    } else if (kind == "notempty") {
+      good = args.size() == 3;
+      if (good) g.addNotEmpty(args[1].c_str(), args[2].c_str());
+    } else if (kind == "cut") {
+      vector<Double_t> x, y;
+      good = args.size() >= 10 && args.size()%2 == 0;
+      for (unsigned int i=4; good && i<args.size(); i += 2) {
+        good = number(args[i], low) && number(args[i+1], high);
+        x.push_back(low);
+        y.push_back(high);
+      }
+      if (good) g.addCut(args[1].c_str(), args[2].c_str(), args[3].c_str(), x, y);
+    } else if (kind == "all") {
+      good = args.size() == 2;
+      if (good) g.addAll(args[1].c_str());
+    } else {
+      good = false;
+    }
+    if (!good) {
+      cout<<"Bad gate \""<<line<<"\" in "<<filename<<" (window, notempty, cut, all or require)"<<endl;
+      return false;
+    }
+    Int_t bit = firstBit+g.nodes.size()-1;
+    if (bit >= MAX_BITS) {
+      cout<<"Too many gates in "<<filename<<", at most "<<MAX_BITS-firstBit<<endl;
+      return false;
+    }
+    g.nodes.back().bit = bit;
+    g.nodes.back().needs = needs;
+  }
+  for (unsigned int i=0; i<required.size(); i++) {
+    Int_t k = g.find(required[i]);
+    if (k < 0) {
+      cout<<"Unknown gate "<<required[i]<<" required in "<<filename<<endl;
+      return false;
+    }
+    g.nodes[k].require = true;
+  }
+  *this = g;
+  return true;
+}
+
+/*merge
+ *Adds the gates of another graph; false if one of them is already declared here
+ */
+bool GateGraph::merge(const GateGraph &other) {
+  for (unsigned int k=0; k<other.nodes.size(); k++) {
+    if (find(other.nodes[k].name) >= 0) {
+      cout<<"Gate "<<other.nodes[k].name<<" is declared twice"<<endl;
+      return false;
+    }
+  }
+  nodes.insert(nodes.end(), other.nodes.begin(), other.nodes.end());
+  return true;
+}
+
+UInt_t GateGraph::outputs() const {
+  UInt_t mask = 0;
+  for (unsigned int k=0; k<nodes.size(); k++) {
+    if (nodes[k].bit >= 0) mask |= 1u<<nodes[k].bit;
+  }
+  return mask;
+}
+
+UInt_t GateGraph::required() const {
+  UInt_t mask = 0;
+  for (unsigned int k=0; k<nodes.size(); k++) {
+    if (nodes[k].bit >= 0 && nodes[k].require) mask |= 1u<<nodes[k].bit;
+  }
+  return mask;
+}
+
+vector<string> GateGraph::names() const {
+  vector<string> list;
+  for (unsigned int k=0; k<nodes.size(); k++) {
+    if (nodes[k].bit >= 0) list.push_back(nodes[k].name);
+  }
+  return list;
+}
+
+Int_t GateGraph::variable(const string &name) {
+  for (unsigned int v=0; v<vars.size(); v++) {
+    if (vars[v] == name) return v;
+  }
+  vars.push_back(name);
+  return vars.size()-1;
+}
+
+/*visit
+ *Adds the operation of a gate after those of the gates it needs (depth first); the needed
+ *gates with a bit outside the selection are read from the given mask instead
+ */
+bool GateGraph::visit(Int_t k, UInt_t selection, vector<Int_t> &state, vector<Int_t> &opOf) {
+  if (state[k] == 2) return true;
+  if (state[k] == 1) {
+    cout<<"Gate "<<nodes[k].name<<" needs itself"<<endl;
+    return false;
+  }
+  state[k] = 1;
+  const Node &node = nodes[k];
+  Op op;
+  op.node = k;
+  op.kind = node.kind;
+  op.x = op.y = -1;
+  op.low = node.low;
+  op.high = node.high;
+  op.firstEdge = op.nedges = 0;
+  op.bit = node.bit;
+  op.events = op.passed = 0;
+  op.seconds = 0;
+  for (unsigned int i=0; i<node.needs.size(); i++) {
+    Int_t j = find(node.needs[i]);
+    if (j < 0) {
+      cout<<"Gate "<<node.name<<" needs the unknown gate "<<node.needs[i]<<endl;
+      return false;
+    }
+    if (nodes[j].bit >= 0 && !(selection & (1u<<nodes[j].bit))) {
+      op.givenBits.push_back(nodes[j].bit);
+    } else {
+      if (!visit(j, selection, state, opOf)) return false;
+      op.inputs.push_back(opOf[j]);
+    }
+  }
+  if (node.kind != ALL) op.x = variable(node.varX);
+  if (node.kind == CUT) {
+    op.y = variable(node.varY);
+    op.firstEdge = edgeX1.size();
+    op.nedges = node.x.size();
+    for (int i=0; i<op.nedges; i++) { //edges in the order of TMath::IsInside
+      int j = (i == 0) ? op.nedges-1 : i-1;
+      edgeX1.push_back(node.x[i]); edgeY1.push_back(node.y[i]);
+      edgeX2.push_back(node.x[j]); edgeY2.push_back(node.y[j]);
+      edgeDY.push_back((node.y[j] != node.y[i]) ? node.y[j]-node.y[i] : 1.0); //flat edges never cross
+    }
+  }
+  opOf[k] = ops.size();
+  ops.push_back(op);
+  state[k] = 2;
+  return true;
+}
+
+/*compile
+ *Flattens the gates with a bit in selection, and the gates they need, into the operation list
+ */
+bool GateGraph::compile(UInt_t selection) {
+  ops.clear();
+  vars.clear();
+  edgeX1.clear(); edgeY1.clear(); edgeX2.clear(); edgeY2.clear(); edgeDY.clear();
+  vector<Int_t> state(nodes.size(), 0), opOf(nodes.size(), -1);
+  for (unsigned int k=0; k<nodes.size(); k++) {
+    if (nodes[k].bit >= 0 && (selection & (1u<<nodes[k].bit)) && !visit(k, selection, state, opOf)) {
+      ops.clear();
+      vars.clear();
+      compiled = 0;
+      return false;
+    }
+  }
+  compiled = selection;
+  results.assign(ops.size(), vector<UChar_t>());
+  return true;
+}
+
+/*evaluate
+ *Gate mask of n events: the selected bits from the predicate, the others from given (0 if
+ *given is NULL). columns holds an array of n values for each of variables()
+ */
+void GateGraph::evaluate(Int_t n, const Float_t* const *columns, const UInt_t *given, UInt_t *mask) {
+  if (n <= 0) return;
+  for (int i=0; i<n; i++) mask[i] = given ? (given[i] & ~compiled) : 0;
+  for (unsigned int k=0; k<ops.size(); k++) {
+    Op &op = ops[k];
+    auto start = chrono::steady_clock::now();
+    if ((Int_t)results[k].size() < n) results[k].resize(n);
+    UChar_t *r = &results[k][0];
+    if (op.kind == WINDOW) {
+      const Float_t *v = columns[op.x];
+      const Float_t low = op.low, high = op.high;
+      for (int i=0; i<n; i++) r[i] = (v[i] > low) & (v[i] < high);
+    } else if (op.kind == NOTEMPTY) {
+      const Float_t *v = columns[op.x];
+      for (int i=0; i<n; i++) r[i] = v[i] > 1.0f;
+    } else if (op.kind == CUT) {
+      const Float_t *vx = columns[op.x], *vy = columns[op.y];
+      for (int i=0; i<n; i++) r[i] = 0;
+      for (int e=op.firstEdge; e<op.firstEdge+op.nedges; e++) {
+        const Double_t x1 = edgeX1[e], y1 = edgeY1[e], x2 = edgeX2[e], y2 = edgeY2[e], dy = edgeDY[e];
+        for (int i=0; i<n; i++) {
+          const Double_t xp = vx[i], yp = vy[i];
+          r[i] ^= (((y1 < yp) & (y2 >= yp)) | ((y2 < yp) & (y1 >= yp))) & (x1+(yp-y1)/dy*(x2-x1) < xp);
+        }
+      }
+    } else {
+      for (int i=0; i<n; i++) r[i] = 1;
+    }
+    for (unsigned int j=0; j<op.inputs.size(); j++) {
+      const UChar_t *in = &results[op.inputs[j]][0];
+      for (int i=0; i<n; i++) r[i] &= in[i];
+    }
+    for (unsigned int j=0; j<op.givenBits.size(); j++) {
+      const Int_t b = op.givenBits[j];
+      if (given) for (int i=0; i<n; i++) r[i] &= (given[i]>>b) & 1;
+      else for (int i=0; i<n; i++) r[i] = 0;
+    }
+    Long64_t passed = 0;
+    for (int i=0; i<n; i++) passed += r[i];
+    if (op.bit >= 0) {
+      const Int_t b = op.bit;
+      for (int i=0; i<n; i++) mask[i] |= (UInt_t)r[i]<<b;
+    }
+    op.events += n;
+    op.passed += passed;
+    op.seconds += chrono::duration<double>(chrono::steady_clock::now()-start).count();
+  }
+}
+
+/*print
+ *Events passing and evaluation time of each operation of the compiled predicate
+ */
+void GateGraph::print(ostream &output) const {
+  ios::fmtflags flags = output.flags();
+  streamsize precision = output.precision();
+  output<<"Gate predicate, "<<ops.size()<<" operations on "<<vars.size()<<" variables:"<<endl;
+  for (unsigned int k=0; k<ops.size(); k++) {
+    const Op &op = ops[k];
+    Double_t ns = (op.events > 0) ? 1e9*op.seconds/op.events : 0;
+    output<<"  "<<left<<setw(16)<<nodes[op.node].name<<right<<setw(12)<<op.passed<<" of "<<op.events
+          <<fixed<<setprecision(2)<<setw(10)<<ns<<" ns/event"<<endl;
+    output.flags(flags);
+    output.precision(precision);
+  }
+}
+
+void GateGraph::report() const {
+  for (unsigned int k=0; k<ops.size(); k++) {
+    const string &name = nodes[ops[k].node].name;
+    Instrument::addTime(("gate_"+name).c_str(), ops[k].seconds);
+    Instrument::count(("events_pass_"+name).c_str(), ops[k].passed);
+  }
+}
@@ -0,0 +1,57 @@
+/*HistoSet.cpp
+ *Histograms filled by one analysis step. See HistoSet.h
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#include "HistoSet.h"
+
+HistoSet::~HistoSet() {
+  for(unsigned int i=0; i<targets.size(); i++) delete targets[i].fast;
+}
+
+void HistoSet::add(TH1 *histo) {
+  Target t;
+  t.histo = histo;
+  t.filler = NULL;
+  t.fast = NULL;
+  targets.push_back(t);
+}
+
+void HistoSet::useFast() {
+  for(unsigned int i=0; i<targets.size(); i++) {
+    if(!targets[i].fast) targets[i].fast = new FastFill(targets[i].histo);
+  }
+}
+
+void HistoSet::flush() {
+  for(unsigned int i=0; i<targets.size(); i++) {
+    if(targets[i].fast) targets[i].fast->flush();
+  }
+}
+
+vector<DenseHist*> HistoSet::makeDense(Int_t nthreads, DenseHist::Mode mode) {
+  vector<DenseHist*> dense;
+  for(unsigned int i=0; i<targets.size(); i++) dense.push_back(new DenseHist(targets[i].histo, nthreads, mode));
+  return dense;
+}
+
+HistoSet HistoSet::forThread(vector<DenseHist*> &dense) {
+  HistoSet set;
+  for(unsigned int i=0; i<targets.size(); i++) {
+    Target t;
+    t.histo = targets[i].histo;
+    t.filler = dense[i]->filler();
+    t.fast = NULL;
+    set.targets.push_back(t);
+  }
+  return set;
+}
+
+void HistoSet::addDense(vector<DenseHist*> &dense) {
+  for(unsigned int i=0; i<targets.size(); i++) {
+    dense[i]->addTo(targets[i].histo);
+    delete dense[i];
+  }
+  dense.clear();
+}
@@ -0,0 +1,107 @@
+/*Instrument.cpp
+ *Stage timers and counters, and the per-run report. See Instrument.h
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#include "Instrument.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <ctime>
+
+using namespace std;
+
+bool Instrument::enabled = false;
+
+namespace {
+  struct Stage {
+    Double_t seconds;
+    Long64_t calls;
+  };
+  string reportFile;
+  vector<string> stageOrder, counterOrder; //report in the order first seen
+  map<string, Stage> stages;
+  map<string, Long64_t> counters;
+  mutex reportLock;
+  chrono::steady_clock::time_point runStart;
+}
+
+void Instrument::enable(const char* reportName) {
+  reportFile = reportName;
+  runStart = chrono::steady_clock::now();
+  enabled = true;
+}
+
+void Instrument::addTime(const char* stage, Double_t seconds) {
+  if (!enabled) return;
+  lock_guard<mutex> guard(reportLock);
+  map<string, Stage>::iterator it = stages.find(stage);
+  if (it == stages.end()) {
+    stageOrder.push_back(stage);
+    Stage s = {seconds, 1};
+    stages[stage] = s;
+  } else {
+    it->second.seconds += seconds;
+    it->second.calls++;
+  }
+}
+
+void Instrument::count(const char* counter, Long64_t n) {
+  if (!enabled) return;
+  lock_guard<mutex> guard(reportLock);
+  map<string, Long64_t>::iterator it = counters.find(counter);
+  if (it == counters.end()) {
+    counterOrder.push_back(counter);
+    counters[counter] = n;
+  } else {
+    it->second += n;
+  }
+}
+
+/*report
+ *JSON: {"start": time, "wall_seconds": s, "stages": {name: {"seconds": s, "calls": n}}, "counters": {name: n}}
+ *CSV: kind,name,value,calls lines
+ */
+void Instrument::report() {
+  if (!enabled) return;
+  lock_guard<mutex> guard(reportLock);
+  Double_t wall = chrono::duration<double>(chrono::steady_clock::now()-runStart).count();
+  ofstream output(reportFile.c_str());
+  if (!output.is_open()) {
+    cout<<"Unable to write the run report "<<reportFile<<endl;
+    return;
+  }
+  bool csv = reportFile.size() > 4 && reportFile.compare(reportFile.size()-4, 4, ".csv") == 0;
+  if (csv) {
+    output<<"kind,name,value,calls"<<endl;
+    output<<"run,wall_seconds,"<<wall<<",1"<<endl;
+    for (unsigned int i=0; i<stageOrder.size(); i++) {
+      Stage &s = stages[stageOrder[i]];
+      output<<"stage,"<<stageOrder[i]<<","<<s.seconds<<","<<s.calls<<endl;
+    }
+    for (unsigned int i=0; i<counterOrder.size(); i++) {
+      output<<"counter,"<<counterOrder[i]<<","<<counters[counterOrder[i]]<<",1"<<endl;
+    }
+  } else {
+    output<<"{"<<endl;
+    output<<"  \"start\": "<<(long) time(NULL)-(long) wall<<","<<endl;
+    output<<"  \"wall_seconds\": "<<wall<<","<<endl;
+    output<<"  \"stages\": {";
+    for (unsigned int i=0; i<stageOrder.size(); i++) {
+      Stage &s = stages[stageOrder[i]];
+      output<<(i ? "," : "")<<endl<<"    \""<<stageOrder[i]<<"\": {\"seconds\": "<<s.seconds
+            <<", \"calls\": "<<s.calls<<"}";
+    }
+    output<<endl<<"  },"<<endl;
+    output<<"  \"counters\": {";
+    for (unsigned int i=0; i<counterOrder.size(); i++) {
+      output<<(i ? "," : "")<<endl<<"    \""<<counterOrder[i]<<"\": "<<counters[counterOrder[i]];
+    }
+    output<<endl<<"  }"<<endl<<"}"<<endl;
+  }
+  cout<<"Run report written to "<<reportFile<<endl;
+}
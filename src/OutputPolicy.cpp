@@ -0,0 +1,135 @@
+/*OutputPolicy.cpp
+ *Branch selection, accepted-only filtering, basket/cluster sizing and compression for output
+ *trees. See OutputPolicy.h for the policy file format
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#include "OutputPolicy.h"
+#include "Compression.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+using namespace std;
+
+OutputPolicy::OutputPolicy() :
+  acceptedOnly(false), basketSize(32000), autoFlush(0), algorithm(-1), level(0),
+  description("default"), writeTime(0)
+{
+}
+
+/*load
+ *Reads a policy file; returns false (and keeps the defaults) if it can't be opened or has
+ *an unknown setting
+ */
+bool OutputPolicy::load(const char* filename) {
+  ifstream input(filename);
+  if(!input.is_open()) {
+    cout<<"Unable to open output policy "<<filename<<"; using the default"<<endl;
+    return false;
+  }
+  OutputPolicy defaults;
+  string line;
+  while(getline(input, line)) {
+    size_t comment = line.find('#');
+    if(comment != string::npos) line.erase(comment);
+    istringstream words(line);
+    string key;
+    if(!(words>>key)) continue;
+    if(key == "branches") {
+      string name;
+      while(words>>name) branches.push_back(name);
+    } else if(key == "acceptedOnly") {
+      words>>acceptedOnly;
+    } else if(key == "basketSize") {
+      words>>basketSize;
+    } else if(key == "autoFlush") {
+      words>>autoFlush;
+    } else if(key == "compression") {
+      string alg;
+      words>>alg>>level;
+      if(alg == "zlib") algorithm = ROOT::RCompressionSetting::EAlgorithm::kZLIB;
+      else if(alg == "lzma") algorithm = ROOT::RCompressionSetting::EAlgorithm::kLZMA;
+      else if(alg == "lz4") algorithm = ROOT::RCompressionSetting::EAlgorithm::kLZ4;
+      else if(alg == "zstd") algorithm = ROOT::RCompressionSetting::EAlgorithm::kZSTD;
+      else {
+        cout<<"Unknown compression algorithm "<<alg<<" in "<<filename<<"; using the default policy"<<endl;
+        *this = defaults;
+        return false;
+      }
+    } else {
+      cout<<"Unknown output policy setting "<<key<<" in "<<filename<<"; using the default policy"<<endl;
+      *this = defaults;
+      return false;
+    }
+  }
+  description = filename;
+  return true;
+}
+
+void OutputPolicy::require(const char* name) {
+  if(branches.empty() || keep(name)) return;
+  cout<<"Output policy: "<<name<<" is needed downstream, writing it anyway"<<endl;
+  branches.push_back(name);
+}
+
+bool OutputPolicy::keep(const char* name) {
+  return branches.empty() || find(branches.begin(), branches.end(), name) != branches.end();
+}
+
+void OutputPolicy::apply(TFile *file) {
+  if(algorithm >= 0) {
+    file->SetCompressionSettings(ROOT::CompressionSettings((ROOT::RCompressionSetting::EAlgorithm::EValues) algorithm, level));
+  }
+}
+
+void OutputPolicy::apply(TTree *tree) {
+  if(autoFlush > 0) tree->SetAutoFlush(autoFlush);
+}
+
+/*branch
+ *Makes the branch (with the policy basket size) if the policy writes it; NULL if not
+ */
+TBranch* OutputPolicy::branch(TTree *tree, const char* name, void *address, const char* leaflist) {
+  if(!keep(name)) return NULL;
+  return tree->Branch(name, address, leaflist, basketSize);
+}
+
+bool OutputPolicy::accept(Int_t cutFlag, Int_t coincFlag) {
+  return !acceptedOnly || cutFlag || coincFlag;
+}
+
+void OutputPolicy::addWriteTime(Double_t seconds) {
+  writeTime += seconds;
+}
+
+/*signature
+ *Every setting as text; the same for two policies only if they write the same tree
+ */
+string OutputPolicy::signature() const {
+  ostringstream text;
+  text<<"branches";
+  if(branches.empty()) text<<" all";
+  for(unsigned int i=0; i<branches.size(); i++) text<<" "<<branches[i];
+  text<<"; acceptedOnly "<<acceptedOnly<<"; basketSize "<<basketSize<<"; autoFlush "<<autoFlush
+      <<"; compression "<<algorithm<<" "<<level;
+  return text.str();
+}
+
+/*report
+ *Output size and write throughput of tree; call after the tree is written
+ */
+void OutputPolicy::report(TTree *tree, TFile *file) {
+  Double_t raw = tree->GetTotBytes()/1048576.0, zipped = tree->GetZipBytes()/1048576.0;
+  cout<<"Output policy "<<description<<": "<<tree->GetName()<<" "<<tree->GetEntries()<<" entries, "
+      <<tree->GetListOfBranches()->GetEntries()<<" branches"<<endl;
+  cout<<"  "<<zipped<<" MB on disk ("<<raw<<" MB uncompressed";
+  if(zipped > 0) cout<<", ratio "<<raw/zipped;
+  cout<<"), file "<<file->GetEND()/1048576.0<<" MB"<<endl;
+  if(writeTime > 0) {
+    cout<<"  fill+write "<<writeTime<<" s: "<<raw/writeTime<<" MB/s uncompressed, "
+        <<tree->GetEntries()/writeTime<<" entries/s"<<endl;
+  }
+}
@@ -0,0 +1,230 @@
+/*RunMerge.cpp
+ *Merging of the outputs of many runs. See RunMerge.h
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#include "RunMerge.h"
+#include "TTree.h"
+#include "TKey.h"
+#include "TClass.h"
+#include "Instrument.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <set>
+#include <thread>
+#include <sys/stat.h>
+
+using namespace std;
+
+/*load
+ *Reads the data names of the runs (as given to the analysis, w/o .root), one per line with
+ *# for comments. Runs whose _histo.root or _corr.root is missing are left out of that merge
+ */
+bool RunMerge::load(const char* listName) {
+  ifstream input(listName);
+  if (!input.is_open()) {
+    cout<<"Unable to open the run list "<<listName<<endl;
+    return false;
+  }
+  histoFiles.clear();
+  corrFiles.clear();
+  string line;
+  struct stat info;
+  while (getline(input, line)) {
+    size_t comment = line.find('#');
+    if (comment != string::npos) line.erase(comment);
+    istringstream words(line);
+    string name;
+    if (!(words>>name)) continue;
+    string histo = name+"_histo.root", corr = name+"_corr.root";
+    if (stat(histo.c_str(), &info) == 0) histoFiles.push_back(histo);
+    else cout<<"No "<<histo<<", not merged"<<endl;
+    if (stat(corr.c_str(), &info) == 0) corrFiles.push_back(corr);
+    else cout<<"No "<<corr<<", not merged"<<endl;
+  }
+  if (histoFiles.empty() && corrFiles.empty()) {
+    cout<<"No runs to merge in "<<listName<<endl;
+    return false;
+  }
+  return true;
+}
+
+/*add
+ *Adds h to the histogram of the same name in sum, or keeps it if there is none yet. A
+ *histogram with other binning than the one already there is left out
+ */
+void RunMerge::add(Sum &sum, TH1 *h) {
+  map<string, Int_t>::iterator found = sum.index.find(h->GetName());
+  if (found == sum.index.end()) {
+    sum.index[h->GetName()] = sum.histos.size();
+    sum.histos.push_back(h);
+    return;
+  }
+  TH1 *total = sum.histos[found->second];
+  if (total->GetDimension() != h->GetDimension() || total->GetNcells() != h->GetNcells()) {
+    cout<<"Histogram "<<h->GetName()<<" has other binning than in the first run, left out"<<endl;
+  } else {
+    total->Add(h);
+  }
+  delete h;
+}
+
+void RunMerge::add(Sum &into, Sum &from) {
+  for (unsigned int i=0; i<from.histos.size(); i++) add(into, from.histos[i]);
+  from.histos.clear();
+  from.index.clear();
+}
+
+/*sumFile
+ *Adds every histogram (TH1 and derived) in the file to sum (the highest cycle of each name);
+ *the class is checked before anything is read
+ */
+void RunMerge::sumFile(const string &fileName, Sum &sum) {
+  TFile *file = TFile::Open(fileName.c_str(), "READ");
+  if (!file || file->IsZombie()) {
+    cout<<"Unable to open "<<fileName<<", not merged"<<endl;
+    return;
+  }
+  set<string> seen;
+  TIter next(file->GetListOfKeys());
+  TKey *key;
+  while ((key = (TKey*) next())) {
+    TClass *type = TClass::GetClass(key->GetClassName());
+    if (!type || !type->InheritsFrom(TH1::Class())) continue; //histograms only (not THnSparse, THStack, ...)
+    if (!seen.insert(key->GetName()).second) continue; //lower cycle
+    TH1 *h = (TH1*) key->ReadObj();
+    if (!h) continue;
+    h->SetDirectory(0); //kept after the file is closed
+    add(sum, h);
+  }
+  file->Close();
+  delete file;
+}
+
+/*reduce
+ *Parallel tree reduction of the histograms of files: one partial sum per thread over a
+ *contiguous share of the files, then the partial sums are added in pairs (t += t+stride,
+ *stride doubling) until all are in the first
+ */
+void RunMerge::reduce(const vector<string> &files, Sum &total) {
+  Int_t n = thread::hardware_concurrency();
+  if (n > (Int_t) files.size()) n = files.size();
+  if (n < 1) n = 1;
+  vector<Sum> partial(n);
+  vector<thread> workers;
+  for (Int_t t=0; t<n; t++) {
+    size_t first = files.size()*t/n;
+    size_t last = files.size()*(t+1)/n;
+    workers.push_back(thread([&files, &partial, first, last, t]() {
+      for (size_t i=first; i<last; i++) sumFile(files[i], partial[t]);
+    }));
+  }
+  for (unsigned int t=0; t<workers.size(); t++) workers[t].join();
+  for (Int_t stride=1; stride<n; stride*=2) {
+    workers.clear();
+    for (Int_t t=0; t+stride<n; t+=2*stride) {
+      workers.push_back(thread([&partial, t, stride]() { add(partial[t], partial[t+stride]); }));
+    }
+    for (unsigned int w=0; w<workers.size(); w++) workers[w].join();
+  }
+  add(total, partial[0]);
+}
+
+/*mergeTrees
+ *Concatenates the correctTrees of files into one in output. The baskets are copied as they
+ *are ("fast", whatever their compression) from every file compressed like the first one;
+ *the others are reported and copied entry by entry, so the merged tree is compressed the
+ *same way throughout. ROOT also falls back to the entry copy if the branch layouts differ
+ */
+Long64_t RunMerge::mergeTrees(const vector<string> &files, TFile *output) {
+  Instrument::Timer t("merge_trees");
+  TTree *merged = NULL;
+  Int_t compression = -1; //of the first file
+  for (unsigned int i=0; i<files.size(); i++) {
+    TFile *file = TFile::Open(files[i].c_str(), "READ");
+    if (!file || file->IsZombie()) continue; //reported by sumFile
+    TTree *tree = (TTree*) file->Get("correctTree");
+    if (!tree) {
+      cout<<files[i]<<" has no correctTree, not merged"<<endl;
+    } else {
+      output->cd();
+      if (!merged) {
+        merged = tree->CloneTree(0);
+        compression = file->GetCompressionSettings();
+        output->SetCompressionSettings(compression);
+      }
+      if (file->GetCompressionSettings() == compression) {
+        merged->CopyEntries(tree, -1, "fast");
+      } else {
+        cout<<files[i]<<" is compressed with settings "<<file->GetCompressionSettings()<<", not "
+            <<compression<<" like the first run; its correctTree is recompressed (slower)"<<endl;
+        merged->CopyEntries(tree, -1, "");
+        Instrument::count("merge_recompressed_runs");
+      }
+    }
+    file->Close();
+    delete file;
+  }
+  if (!merged) return 0;
+  output->cd();
+  merged->Write(merged->GetName(), TObject::kOverwrite);
+  return merged->GetEntries();
+}
+
+/*write
+ *Writes the summed histograms to the current directory and deletes them
+ */
+void RunMerge::write(Sum &sum) {
+  for (unsigned int i=0; i<sum.histos.size(); i++) {
+    sum.histos[i]->Write(0, TObject::kOverwrite);
+    delete sum.histos[i];
+  }
+  sum.histos.clear();
+  sum.index.clear();
+}
+
+/*run
+ *Sums the _histo.root histograms into histoName and the _corr.root ones into corrName, and
+ *concatenates the correctTrees into corrName alongside (on a thread of their own)
+ */
+bool RunMerge::run(char* histoName, char* corrName) {
+  TDirectory *current = gDirectory;
+  TFile *histoOut = new TFile(histoName, "RECREATE");
+  TFile *corrOut = new TFile(corrName, "RECREATE");
+  if (histoOut->IsZombie() || corrOut->IsZombie()) {
+    cout<<"Unable to create "<<histoName<<" and "<<corrName<<endl;
+    delete histoOut;
+    delete corrOut;
+    current->cd();
+    return false;
+  }
+  Instrument::count("merge_runs", histoFiles.size());
+
+  Long64_t treeEntries = 0;
+  thread trees([this, corrOut, &treeEntries]() { treeEntries = mergeTrees(corrFiles, corrOut); });
+
+  Instrument::Timer t("merge_histos");
+  Sum histos, corrHistos;
+  reduce(histoFiles, histos);
+  reduce(corrFiles, corrHistos);
+  t.stop();
+  trees.join();
+
+  Instrument::Timer w("merge_write");
+  histoOut->cd();
+  write(histos);
+  corrOut->cd();
+  write(corrHistos);
+  w.stop();
+  Instrument::count("merge_tree_entries", treeEntries);
+  cout<<"Merged the histograms of "<<histoFiles.size()<<" runs into "<<histoName<<" and of "
+      <<corrFiles.size()<<" runs into "<<corrName<<" ("<<treeEntries<<" correctTree entries)"<<endl;
+  histoOut->Close();
+  corrOut->Close();
+  delete histoOut;
+  delete corrOut;
+  current->cd();
+  return true;
+}
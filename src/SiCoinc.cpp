@@ -0,0 +1,79 @@
+/*SiCoinc.cpp
+ *Silicon coincidence windows and random subtraction. See SiCoinc.h for the window file format
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#include "SiCoinc.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+SiCoinc::SiCoinc() {
+}
+
+/*load
+ *Reads a window file; returns false (and leaves the coincidence stage off) if it can't be
+ *opened, has an unknown line or has no prompt window
+ */
+bool SiCoinc::load(const char* filename) {
+  ifstream input(filename);
+  if(!input.is_open()) {
+    cout<<"Unable to open the si coincidence windows "<<filename<<endl;
+    return false;
+  }
+  vector<Window> p, r;
+  string line;
+  while(getline(input, line)) {
+    size_t comment = line.find('#');
+    if(comment != string::npos) line.erase(comment);
+    istringstream words(line);
+    string kind;
+    Window w;
+    if(!(words>>kind)) continue;
+    if(!(words>>w.low>>w.high) || w.high <= w.low+1 || (kind != "prompt" && kind != "random")) {
+      cout<<"Bad si coincidence window \""<<line<<"\" in "<<filename<<endl;
+      return false;
+    }
+    if(kind == "prompt") p.push_back(w);
+    else r.push_back(w);
+  }
+  if(p.empty()) {
+    cout<<"No prompt window in "<<filename<<endl;
+    return false;
+  }
+  prompt = p;
+  random = r;
+  return true;
+}
+
+/*randomScale
+ *Channels inside the prompt windows over channels inside the random windows (the bounds are
+ *exclusive), 0 if there are no random windows
+ */
+Double_t SiCoinc::randomScale() const {
+  Double_t promptWidth = 0, randomWidth = 0;
+  for(unsigned int w=0; w<prompt.size(); w++) promptWidth += prompt[w].high-prompt[w].low-1;
+  for(unsigned int w=0; w<random.size(); w++) randomWidth += random[w].high-random[w].low-1;
+  return (randomWidth > 0) ? promptWidth/randomWidth : 0;
+}
+
+/*subtract
+ *result = prompt - randomScale*random, bin by bin with errors
+ */
+void SiCoinc::subtract(TH1 *promptHisto, TH1 *randomHisto, TH1 *result) const {
+  result->Reset();
+  if(!result->GetSumw2N()) result->Sumw2();
+  result->Add(promptHisto, randomHisto, 1.0, -randomScale());
+}
+
+void SiCoinc::print() const {
+  cout<<"Si coincidence windows:";
+  for(unsigned int w=0; w<prompt.size(); w++) cout<<" prompt "<<prompt[w].low<<"-"<<prompt[w].high;
+  for(unsigned int w=0; w<random.size(); w++) cout<<" random "<<random[w].low<<"-"<<random[w].high;
+  cout<<endl;
+  if(!random.empty()) cout<<"  randoms subtracted with a scale of "<<randomScale()<<endl;
+}
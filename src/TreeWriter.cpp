@@ -0,0 +1,132 @@
+/*TreeWriter.cpp
+ *Write-behind stage for output trees. See TreeWriter.h
+ *
+ *Gordon M. -- Aug 2019
+ */
+
+#include "TreeWriter.h"
+#include "TBranch.h"
+#include "TObjArray.h"
+#include <iostream>
+#include <cstring>
+
+using namespace std;
+
+TreeWriter::TreeWriter(TTree *t) :
+  tree(t), recordSize(0), blocks(NBLOCKS), freeRing(NBLOCKS), fullRing(NBLOCKS), freeHead(0),
+  freeCount(NBLOCKS), fullHead(0), fullCount(0), current(-1), done(false), stalls(0), fillTime(0)
+{
+  //take over the branch addresses; every leaf here is a plain number (leaflist branches)
+  TObjArray *branches = tree->GetListOfBranches();
+  for(Int_t i=0; i<branches->GetEntries(); i++) {
+    TBranch *branch = (TBranch*) branches->At(i);
+    TLeaf *leaf = (TLeaf*) branch->GetListOfLeaves()->At(0);
+    Slot slot;
+    slot.source = branch->GetAddress();
+    slot.shadow = NULL;
+    slot.size = leaf->GetLenType()*leaf->GetLen();
+    slots.push_back(slot);
+    recordSize += slot.size;
+  }
+  shadows.resize(recordSize);
+  Int_t offset = 0;
+  for(Int_t i=0; i<branches->GetEntries(); i++) {
+    slots[i].shadow = &shadows[offset];
+    ((TBranch*) branches->At(i))->SetAddress(slots[i].shadow);
+    offset += slots[i].size;
+  }
+  for(Int_t i=0; i<NBLOCKS; i++) {
+    blocks[i].records.resize(BLOCK_RECORDS*recordSize);
+    blocks[i].n = 0;
+    freeRing[i] = i;
+  }
+  writer = thread(&TreeWriter::writeLoop, this);
+}
+
+TreeWriter::~TreeWriter() {
+  finish();
+}
+
+void TreeWriter::Fill() {
+  if(current < 0) {
+    unique_lock<mutex> guard(lock);
+    if(freeCount == 0) stalls++;
+    freeReady.wait(guard, [this]{return freeCount > 0;});
+    current = freeRing[freeHead];
+    freeHead = (freeHead+1)%NBLOCKS;
+    freeCount--;
+    blocks[current].n = 0;
+  }
+  Block &block = blocks[current];
+  char *record = &block.records[block.n*recordSize];
+  for(unsigned int i=0; i<slots.size(); i++) {
+    memcpy(record, slots[i].source, slots[i].size);
+    record += slots[i].size;
+  }
+  block.n++;
+  if(block.n == BLOCK_RECORDS) pushCurrent();
+}
+
+void TreeWriter::pushCurrent() {
+  {
+    lock_guard<mutex> guard(lock);
+    fullRing[(fullHead+fullCount)%NBLOCKS] = current;
+    fullCount++;
+  }
+  current = -1;
+  fullReady.notify_one();
+}
+
+/*writeLoop
+ *Writer thread: replays queued records into the tree in order
+ */
+void TreeWriter::writeLoop() {
+  while(true) {
+    Int_t b;
+    {
+      unique_lock<mutex> guard(lock);
+      fullReady.wait(guard, [this]{return fullCount > 0 || done;});
+      if(fullCount == 0) return; //done and drained
+      b = fullRing[fullHead];
+      fullHead = (fullHead+1)%NBLOCKS;
+      fullCount--;
+    }
+    auto start = chrono::steady_clock::now(); //per block, so the timing costs nothing per record
+    const char *record = &blocks[b].records[0];
+    for(Int_t r=0; r<blocks[b].n; r++, record += recordSize) {
+      memcpy(&shadows[0], record, recordSize);
+      tree->Fill();
+    }
+    fillTime += chrono::duration<double>(chrono::steady_clock::now()-start).count();
+    {
+      lock_guard<mutex> guard(lock);
+      freeRing[(freeHead+freeCount)%NBLOCKS] = b;
+      freeCount++;
+    }
+    freeReady.notify_one();
+  }
+}
+
+void TreeWriter::sync() {
+  if(!writer.joinable()) return;
+  if(current >= 0) pushCurrent();
+  unique_lock<mutex> guard(lock);
+  freeReady.wait(guard, [this]{return freeCount == NBLOCKS;}); //every block written and back
+}
+
+void TreeWriter::finish() {
+  if(!writer.joinable()) return;
+  if(current >= 0) pushCurrent();
+  {
+    lock_guard<mutex> guard(lock);
+    done = true;
+  }
+  fullReady.notify_one();
+  writer.join();
+  //give the branches back to the loop variables
+  TObjArray *branches = tree->GetListOfBranches();
+  for(Int_t i=0; i<branches->GetEntries(); i++) {
+    ((TBranch*) branches->At(i))->SetAddress(slots[i].source);
+  }
+  if(stalls > 0) cout<<tree->GetName()<<" writer: event loop waited for the writer "<<stalls<<" times"<<endl;
+}
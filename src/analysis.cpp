@@ -16,10 +16,25 @@ Revised March 2019 to run without reopening and reclosing files as shown by KGH
 #include "analysis.h"
 #include "TCanvas.h"
 #include "FP_kinematics.h"
+#include "TreeWriter.h"
+#include "Instrument.h"
+#include "CutFlow.h"
+#include "fit.h"
+#include "TParameter.h"
 #include <iostream>
+#include <csignal>
+#include <thread>
+#include <chrono>
+#include <string>
 //#include "TApplication.h"
 using namespace std;
 
+//set by ctrl-c in monitor mode
+static volatile sig_atomic_t monitorStop = 0;
+static void stopMonitor(int) {
+  monitorStop = 1;
+}
+
 //constructor
 analysis::analysis() : 
   s1a1_cut(new TCutG("s1a1_cut", 0)),
@@ -27,8 +42,12 @@ analysis::analysis() :
   fp1anode1_cut(new TCutG("fp1anode_cut",0)),
   theta_cut(new TCutG("theta_cut",0)),
   fp1plast_cut(new TCutG("fp1plast_cut",0)),
-  max1(100000), min1(-100000), max2(100000),  min2(-100000)
+  minSi(0), maxSi(0), max1(100000), min1(-100000), max2(100000),  min2(-100000),
+  mtdc_d(0), rawFilled(false), cutName(NULL), sampleStride(1), acceptMask(CutFlow::ACCEPTED),
+  gateFirst(0), gateEnd(0), checkpoint("sort"), firstEntry(0), tcleanFilled(false)
 {
+  nmtdc = channels.width();
+  gateCount = cutflow.counter();
 }
 analysis::~analysis() {
   delete mtdc_d;
@@ -86,6 +105,100 @@ void analysis::GetWeights() {
   w2 = 1.0-w1;
 }
 
+/*fill_raw
+ *sort_raw histograms for one event; done during ingest when the raw file is read
+ */
+void analysis::fill_raw(int entry, HistoSet &h) {
+  const Int_t *mtdc = &mtdc_v[entry*nmtdc];
+  if(notEmpty(mtdc[ChannelMap::FP1]) && notEmpty(mtdc[ChannelMap::FP1+1])){
+    Float_t tdiff1 = calcX1(tdiff1_v[entry]);
+    Float_t tcheck1 = calcTCheck(tsum1_v[entry], anode1_time_v[entry]);
+    h[FP1_TSUM]->Fill(tsum1_v[entry]);
+    h[FP1_TDIFF]->Fill(tdiff1);
+    h[FP1_TCHECK]->Fill(tcheck1);
+  }
+  if(notEmpty(mtdc[ChannelMap::FP2]) && notEmpty(mtdc[ChannelMap::FP2+1])){
+    Float_t tdiff2 = calcX2(tdiff2_v[entry]);
+    Float_t tcheck2 = calcTCheck(tsum2_v[entry], anode2_time_v[entry]);
+    h[FP2_TSUM]->Fill(tsum2_v[entry]);
+    h[FP2_TDIFF]->Fill(tdiff2);
+    h[FP2_TCHECK]->Fill(tcheck2);
+  }
+
+  //Si scattering chamber timing, for setting the coincidence windows
+  if (sicoinc.isEnabled()) {
+    for (int i=ChannelMap::SI; i<nmtdc; i++) {
+      if (mtdc[i] != 0) h[SI_TIME]->Fill(mtdc[i]);
+    }
+  }
+}
+
+/*flushFills
+ *Empties the fast fill buffers of every step into the histograms
+ */
+void analysis::flushFills() {
+  rawSet.flush();
+  tcleanSet.flush();
+  timingSet.flush();
+  fullSet.flush();
+}
+
+/*previewFill
+ *Preview for drawing cuts: fills set from every sampleStride-th event only, in parallel (the
+ *events are split into one contiguous stratum per thread, so the sample covers the whole run
+ *evenly), so the histograms can be shown right away. The rest of the events are then filled
+ *into rest by a background thread while the user draws; finishPreview adds them to set, so
+ *the final histograms (and the cuts applied to them afterwards) use every event.
+ *Both fills go through dense histograms (DenseHist) instead of clones of the ROOT ones
+ */
+void analysis::previewFill(HistoSet &set, StepFill fill, vector<DenseHist*> &rest, thread &background) {
+  flushFills();
+  int nthreads = thread::hardware_concurrency();
+  if (nthreads < 1) nthreads = 1;
+  vector<DenseHist*> sample = set.makeDense(nthreads);
+  vector<HistoSet> targets;
+  for (int t=0; t<nthreads; t++) targets.push_back(set.forThread(sample));
+  vector<thread> workers;
+  for (int t=0; t<nthreads; t++) {
+    workers.push_back(thread([this, &targets, fill, t, nthreads]() {
+      int first = (Long64_t)nentries*t/nthreads;
+      int last = (Long64_t)nentries*(t+1)/nthreads;
+      int start = (first+sampleStride-1)/sampleStride*sampleStride;
+      for (int entry = start; entry < last; entry += sampleStride) {
+        (this->*fill)(entry, targets[t]);
+      }
+    }));
+  }
+  for (int t=0; t<nthreads; t++) workers[t].join();
+  set.addDense(sample);
+  cout<<"Preview from "<<(nentries+sampleStride-1)/sampleStride<<" of "<<nentries
+      <<" events; the rest are filled in the background"<<endl;
+
+  rest = set.makeDense(1);
+  HistoSet restSet = set.forThread(rest);
+  background = thread([this, restSet, fill]() mutable {
+    for (int entry = 0; entry < nentries; entry++) {
+      if (entry%sampleStride) (this->*fill)(entry, restSet);
+    }
+  });
+}
+
+/*finishPreview
+ *Waits for the background fill of a preview and adds it to the histograms
+ */
+void analysis::finishPreview(HistoSet &set, vector<DenseHist*> &rest, thread &background) {
+  if (!background.joinable()) return;
+  background.join();
+  set.addDense(rest);
+}
+
+/*setPreview
+ *Interactive histograms are first shown from a fraction of the events (see previewFill)
+ */
+void analysis::setPreview(double fraction) {
+  if (fraction > 0 && fraction < 1) sampleStride = (int)(1.0/fraction+0.5);
+}
+
 /*sort_raw
  *First sort, takes the data and makes tsum plots
  *Gates are then applied on the sum data
@@ -95,32 +208,20 @@ void analysis::GetWeights() {
 void analysis::sort_raw() {
 
   TCanvas *c1 = new TCanvas();
-  for (int entry = 0; entry < nentries; entry++) {
-     vector<Int_t> mtdc = mtdc_v[entry];
-     if(notEmpty(mtdc[1]) && notEmpty(mtdc[2])){
-       Float_t tdiff1 = tdiff1_v[entry]*1/1.83;
-       Float_t tcheck1 = tsum1_v[entry]/2.0-anode1_time_v[entry]*0.0625;
-       fp1_tsum->Fill(tsum1_v[entry]);
-       fp1_tdiff->Fill(tdiff1);
-       fp1_tcheck->Fill(tcheck1);
-     }
-     if(notEmpty(mtdc[3]) && notEmpty(mtdc[4])){
-       Float_t tdiff2 = tdiff2_v[entry]*1/1.969;
-       Float_t tcheck2 = tsum2_v[entry]/2.0-anode2_time_v[entry]*0.0625;
-       fp2_tsum->Fill(tsum2_v[entry]);
-       fp2_tdiff->Fill(tdiff2);
-       fp2_tcheck->Fill(tcheck2);
-     }
-     
-     //Si scattering chamber coincidence GLORP
-     /*for(int i=16; i<32; i++) {
-       if (mtdc[i] != 0) si_time->Fill(mtdc[i]);
-     }*/
-     //////////////////////////////////
- 
+  vector<DenseHist*> rest;
+  thread background;
+  if (!rawFilled) {
+    if (sampleStride > 1) {
+      previewFill(rawSet, &analysis::fill_raw, rest, background);
+    } else {
+      Instrument::Timer t("sort_raw");
+      for (int entry = 0; entry < nentries; entry++) {
+        fill_raw(entry, rawSet);
+      }
+    }
   }
- 
 
+  flushFills();
 //Where cuts are made; WaitPrimitive returns true until a double click on canvas
   fp1_tcheck->Draw();
   while(c1->WaitPrimitive()) {}
@@ -136,18 +237,373 @@ void analysis::sort_raw() {
   cout<< "enter fp2_tcheck max: ";
   cin >> max2;
   
-  //Si coincidence GLORP
-  /*si_time->Draw();
-  while(c1->WaitPrimitive()) {}
-  cout<<"enter si time min: ";
-  cin >> minSi;
-  cout << "enter si time max: ";
-  cin >> maxSi;*/
-  ////////////////
+  //Si coincidence windows come from the window file (-x, see SiCoinc.h), set from si_time
 
+  finishPreview(rawSet, rest, background);
   c1->Close();
 }
 
+/*fill_tclean
+ *sort_tclean histograms for one event (EdE, x1_x2, fp-anode)
+ */
+void analysis::fill_tclean(int entry, HistoSet &h) {
+  const Int_t *mtdc = &mtdc_v[entry*nmtdc];
+  if (notEmpty(mtdc[ChannelMap::FP1]) && notEmpty(mtdc[ChannelMap::FP1+1]) && notEmpty(mtdc[ChannelMap::FP2]) && notEmpty(mtdc[ChannelMap::FP2+1])) {
+    Float_t tdiff1 = calcX1(tdiff1_v[entry]);
+    Float_t tdiff2 = calcX2(tdiff2_v[entry]);
+    Float_t tcheck1 = calcTCheck(tsum1_v[entry], anode1_time_v[entry]);
+    Float_t tcheck2 = calcTCheck(tsum2_v[entry], anode2_time_v[entry]);
+    Float_t theta = calcAngle(tdiff1, tdiff2);
+
+    if (TCheck1Check(tcheck1)){
+      if(notEmpty(anode1_v[entry])) { 
+        h[SCINT1_ANODE1]->Fill(scint1_v[entry], anode1_v[entry]);
+        h[FP1_ANODE1]->Fill(tdiff1, anode1_v[entry]);
+      }
+      h[X1_X2]->Fill(tdiff1, tdiff2);
+      h[X1_THETA]->Fill(tdiff1, theta);
+    }
+    if (TCheck2Check(tcheck2)) {
+      h[FP2_ANODE2]->Fill(tdiff2, anode2_v[entry]);
+    }
+  }
+}
+
+/*fill_timing
+ *plastic and RF timing histograms for one event, gated on the fp1-anode cut
+ */
+void analysis::fill_timing(int entry, HistoSet &h) {
+  const Int_t *mtdc = &mtdc_v[entry*nmtdc];
+  Float_t tdiff1 = tdiff1_v[entry]*1/1.86;
+  Float_t anode1 = anode1_v[entry];
+  if(fp1anode1_cut->IsInside(tdiff1, anode1)) {
+    Float_t scint1_time = calcScintTime(scint1_time_v[entry]);
+    h[FP1_PLASTIC_TIME]->Fill(tdiff1, scint1_time);
+    Float_t rf_scint_time_wrapped = calcRFWrapped(mtdc[ChannelMap::RF], scint1_time);
+    h[FP1_RF_SCINT_WRAPPED]->Fill(tdiff1, rf_scint_time_wrapped);
+  }
+}
+
+/*fill_full
+ *sort_full for one event: all of the gates, the gated histograms and the SortTree
+ *(no tree if writer is NULL)
+ *The gates come from the compiled gate predicate (buildGates), evaluated for a batch of
+ *events whenever entry is outside the current one; gateMask_n has a bit for each gate passed
+ *(see CutFlow.h) and is counted for the cut flow
+ */
+void analysis::fill_full(int entry, HistoSet &h, TreeWriter *writer) {
+  if (entry < gateFirst || entry >= gateEnd) evalGates(entry);
+  const Int_t *mtdc = &mtdc_v[entry*nmtdc];
+  cutFlag_n = 0;
+  coincFlag_n = 0;
+  gateMask_n = gateMask_v[entry-gateFirst];
+  if (gateMask_n & CutFlow::bit(CutFlow::WIRES)) {
+    tdiff1_n = calcX1(tdiff1_v[entry]);
+    tdiff2_n = calcX2(tdiff2_v[entry]);
+    tcheck1_n = calcTCheck(tsum1_v[entry], anode1_time_v[entry]);
+    tcheck2_n = calcTCheck(tsum2_v[entry], anode2_time_v[entry]);
+    tsum1_n = tsum1_v[entry];
+    tsum2_n = tsum2_v[entry];
+    x_avg_n = tdiff1_n*w1+tdiff2_n*w2;
+    theta_n = calcAngle(tdiff1_n, tdiff2_n);
+    y1_n = anode1_time_v[entry]-scint1_time_v[entry];
+    y2_n = anode2_time_v[entry]-scint1_time_v[entry];
+    scint1_time_n = calcScintTime(scint1_time_v[entry]);
+    rf_scint_wrapped_n = calcRFWrapped(mtdc[ChannelMap::RF], scint1_time_n);
+    scint1_n = scint1_v[entry];
+    anode1_n = anode1_v[entry];
+    anode2_n = anode2_v[entry];
+    phi_n = calcAngle(y1_n, y2_n);
+
+    fill_gated(gateMask_n, acceptMask, h);
+    if (cutFlag_n && sicoinc.isEnabled()) fill_coinc(mtdc, h);
+    if (writer && policy.accept(cutFlag_n, coincFlag_n)) writer->Fill();
+  }
+  gateCount->add(gateMask_n);
+}
+
+/*fill_gated
+ *The gated spectra of sort_full for the event in the tree variables, given its gate mask and
+ *the gates required (all of them in the sort, any combination when re-gating). The ts1a1gate
+ *spectra need the required ones of wires, tcheck1, tcheck2 and fp1plast_cut, the rest all of
+ *them (which also sets cutFlag_n)
+ */
+void analysis::fill_gated(UInt_t mask, UInt_t required, HistoSet &h) {
+  const UInt_t ts1a1gate = required & (CutFlow::bit(CutFlow::WIRES) | CutFlow::bit(CutFlow::TCHECK1) |
+                                       CutFlow::bit(CutFlow::TCHECK2) | CutFlow::bit(CutFlow::FP1PLAST));
+  if ((mask & ts1a1gate) == ts1a1gate) {
+
+    h[FP1_TDIFF_TS1A1GATE]->Fill(tdiff1_n);
+    h[FP1_ANODE_TS1A1GATE]->Fill(tdiff1_n, anode1_n);
+
+    if ((mask & required) == required) {
+
+      h[FP1_TDIFF_ALL]->Fill(tdiff1_n);
+      //if (theta_cut->IsInside(tdiff1_n, theta_n)) fp1_tdiff_all_closed->Fill(tdiff1_n);
+      h[FP1_TDIFFSUM]->Fill(tdiff1_n, tsum1_n);
+      h[XDIFF]->Fill(theta_n);
+      h[XAVG]->Fill(x_avg_n);
+      h[FP1_Y]->Fill(y1_n);
+      h[PHI]->Fill(phi_n);
+      cutFlag_n = 1;         
+    }
+  }
+}
+
+/*fill_coinc
+ *Si scattering chamber coincidence for an accepted event: the prompt and random fp1 position
+ *spectra, and coincFlag_n for prompt events
+ */
+void analysis::fill_coinc(const Int_t *mtdc, HistoSet &h) {
+  UInt_t result = sicoinc.check(mtdc+ChannelMap::SI, channels.nsi());
+  if (result & SiCoinc::PROMPT) {
+    h[FP1_TDIFF_ALL_SITIME]->Fill(tdiff1_n);
+    coincFlag_n = 1;
+    if (theta_cut->IsInside(tdiff1_n, theta_n)) h[FP1_TDIFF_ALL_SITIME_CLOSED]->Fill(tdiff1_n);
+  }
+  if (result & SiCoinc::RANDOM) h[FP1_TDIFF_ALL_SIRANDOM]->Fill(tdiff1_n);
+}
+
+/*finishCoinc
+ *Random subtracted coincidence spectrum, after the fills are flushed
+ */
+void analysis::finishCoinc() {
+  if (sicoinc.isEnabled()) sicoinc.subtract(fp1_tdiff_all_sitime, fp1_tdiff_all_sirandom, fp1_tdiff_all_sitime_sub);
+}
+
+/*setCoincidence
+ *Turns on the si coincidence stage with the windows in the window file (see SiCoinc.h)
+ */
+void analysis::setCoincidence(char* windowName) {
+  if (sicoinc.load(windowName)) sicoinc.print();
+  if (sicoinc.isEnabled() && channels.nsi() == 0) cout<<"The channel map has no si channels"<<endl;
+}
+
+/*setChannelMap
+ *Which mtdc channels are used and what they are (see ChannelMap.h); the evt2root layout
+ *without one
+ */
+void analysis::setChannelMap(char* mapName) {
+  if (channels.load(mapName)) channels.print();
+  nmtdc = channels.width();
+}
+
+/*setGateFile
+ *Extra gates from a gate file (see GateGraph.h), evaluated with the analysis gates in
+ *fill_full; the file is dropped if its gates don't fit together with the analysis gates
+ */
+void analysis::setGateFile(char* gateName) {
+  if (!gateConfig.load(gateName, CutFlow::NGATES)) return;
+  if (!buildGates(~0u)) {
+    cout<<"Not using the gates from "<<gateName<<endl;
+    gateConfig.clear();
+    return;
+  }
+  vector<string> names = gateConfig.names();
+  cout<<"Extra gates:";
+  for (unsigned int i=0; i<names.size(); i++) cout<<" "<<names[i];
+  if (gateConfig.required()) cout<<" (required:";
+  for (unsigned int i=0; i<names.size(); i++) {
+    if (gateConfig.required() & (1u<<(CutFlow::NGATES+i))) cout<<" "<<names[i];
+  }
+  if (gateConfig.required()) cout<<")";
+  cout<<endl;
+}
+
+/*buildGates
+ *Declares the gates of fill_full with the current windows and cuts, adds the extra gates
+ *and compiles the ones with a bit in selection. Every gate but wires needs wires, so an event
+ *without all four delay line signals has a mask of 0, as it always had
+ */
+bool analysis::buildGates(UInt_t selection) {
+  gates.clear();
+  gates.addNotEmpty("fp1_left_hit", "fp1_left");
+  gates.addNotEmpty("fp1_right_hit", "fp1_right");
+  gates.addNotEmpty("fp2_left_hit", "fp2_left");
+  gates.addNotEmpty("fp2_right_hit", "fp2_right");
+  gates.addAll(CutFlow::gateName(CutFlow::WIRES));
+  gates.need(CutFlow::gateName(CutFlow::WIRES), "fp1_left_hit");
+  gates.need(CutFlow::gateName(CutFlow::WIRES), "fp1_right_hit");
+  gates.need(CutFlow::gateName(CutFlow::WIRES), "fp2_left_hit");
+  gates.need(CutFlow::gateName(CutFlow::WIRES), "fp2_right_hit");
+  gates.addWindow(CutFlow::gateName(CutFlow::TCHECK1), "tcheck1", min1, max1);
+  gates.addWindow(CutFlow::gateName(CutFlow::TCHECK2), "tcheck2", min2, max2);
+  //s1a1_cut (scint, anode1) is not used
+  gates.addCut(CutFlow::gateName(CutFlow::FP1PLAST), "x1", "scint_time", fp1plast_cut);
+  gates.addCut(CutFlow::gateName(CutFlow::X1X2), "x1", "x2", x1x2_cut);
+  gates.addCut(CutFlow::gateName(CutFlow::FP1ANODE1), "x1", "anode1", fp1anode1_cut);
+  for (int g=0; g<CutFlow::NGATES; g++) {
+    gates.setBit(CutFlow::gateName(g), g);
+    if (g != CutFlow::WIRES) gates.need(CutFlow::gateName(g), CutFlow::gateName(CutFlow::WIRES));
+  }
+  gateFirst = gateEnd = 0;
+  if (!gates.merge(gateConfig) || !gates.compile(selection)) return false;
+  acceptMask = CutFlow::ACCEPTED | gates.required();
+  const vector<string> &vars = gates.variables();
+  for (unsigned int v=0; v<vars.size(); v++) {
+    if (!gateColumn(vars[v], 0, 0, NULL)) {
+      cout<<"Unknown gate variable "<<vars[v]<<endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+/*gateColumn
+ *Values of a gate variable for n events from first, computed from the storage vectors with
+ *the same helpers (calcX1, ...) as in fill_full (the variables are named as in the SortTree,
+ *plus the raw fp wire signals fp1_left, fp1_right, fp2_left and fp2_right); false if there is
+ *no such variable
+ */
+bool analysis::gateColumn(const string &name, int first, int n, Float_t *out) {
+  if (name == "fp1_left") {
+    for (int i=0; i<n; i++) out[i] = mtdc_v[(first+i)*nmtdc+ChannelMap::FP1];
+  } else if (name == "fp1_right") {
+    for (int i=0; i<n; i++) out[i] = mtdc_v[(first+i)*nmtdc+ChannelMap::FP1+1];
+  } else if (name == "fp2_left") {
+    for (int i=0; i<n; i++) out[i] = mtdc_v[(first+i)*nmtdc+ChannelMap::FP2];
+  } else if (name == "fp2_right") {
+    for (int i=0; i<n; i++) out[i] = mtdc_v[(first+i)*nmtdc+ChannelMap::FP2+1];
+  } else if (name == "x1") {
+    for (int i=0; i<n; i++) out[i] = calcX1(tdiff1_v[first+i]);
+  } else if (name == "x2") {
+    for (int i=0; i<n; i++) out[i] = calcX2(tdiff2_v[first+i]);
+  } else if (name == "tsum1") {
+    for (int i=0; i<n; i++) out[i] = tsum1_v[first+i];
+  } else if (name == "tsum2") {
+    for (int i=0; i<n; i++) out[i] = tsum2_v[first+i];
+  } else if (name == "tcheck1") {
+    for (int i=0; i<n; i++) out[i] = calcTCheck(tsum1_v[first+i], anode1_time_v[first+i]);
+  } else if (name == "tcheck2") {
+    for (int i=0; i<n; i++) out[i] = calcTCheck(tsum2_v[first+i], anode2_time_v[first+i]);
+  } else if (name == "theta") {
+    for (int i=0; i<n; i++) out[i] = calcAngle(calcX1(tdiff1_v[first+i]), calcX2(tdiff2_v[first+i]));
+  } else if (name == "y1") {
+    for (int i=0; i<n; i++) out[i] = anode1_time_v[first+i]-scint1_time_v[first+i];
+  } else if (name == "y2") {
+    for (int i=0; i<n; i++) out[i] = anode2_time_v[first+i]-scint1_time_v[first+i];
+  } else if (name == "phi") {
+    for (int i=0; i<n; i++) {
+      out[i] = calcAngle(anode1_time_v[first+i]-scint1_time_v[first+i], anode2_time_v[first+i]-scint1_time_v[first+i]);
+    }
+  } else if (name == "scint_time") {
+    for (int i=0; i<n; i++) out[i] = calcScintTime(scint1_time_v[first+i]);
+  } else if (name == "rf_scint_wrapped") {
+    for (int i=0; i<n; i++) {
+      out[i] = calcRFWrapped(mtdc_v[(first+i)*nmtdc+ChannelMap::RF], calcScintTime(scint1_time_v[first+i]));
+    }
+  } else if (name == "anode1") {
+    for (int i=0; i<n; i++) out[i] = anode1_v[first+i];
+  } else if (name == "anode2") {
+    for (int i=0; i<n; i++) out[i] = anode2_v[first+i];
+  } else if (name == "scint") {
+    for (int i=0; i<n; i++) out[i] = scint1_v[first+i];
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/*evalGates
+ *Gate masks of the batch of events starting at first, from the compiled predicate
+ */
+void analysis::evalGates(int first) {
+  int n = (nentries-first < GATE_BATCH) ? nentries-first : GATE_BATCH;
+  const vector<string> &vars = gates.variables();
+  vector<const Float_t*> columns(vars.size());
+  gateColumns.resize(vars.size());
+  for (unsigned int v=0; v<vars.size(); v++) {
+    gateColumns[v].resize(GATE_BATCH);
+    gateColumn(vars[v], first, n, &gateColumns[v][0]);
+    columns[v] = &gateColumns[v][0];
+  }
+  gateMask_v.resize(GATE_BATCH);
+  gates.evaluate(n, columns.empty() ? NULL : &columns[0], NULL, &gateMask_v[0]);
+  gateFirst = first;
+  gateEnd = first+n;
+}
+
+/*reportGates
+ *Pass counts and evaluation cost of each gate, printed and handed to the run report
+ */
+void analysis::reportGates() {
+  gates.print(cout);
+  gates.report();
+}
+
+/*setCheckpoint
+ *Checkpoints the sort every period seconds, and resumes it from the last checkpoint in the
+ *histogram file if there is one (see Checkpoint.h)
+ */
+void analysis::setCheckpoint(int period) {
+  checkpoint.setPeriod(period);
+}
+
+/*checkpointSettings
+ *What a checkpoint has to have been made with to be resumed: the channel map, the si windows,
+ *the extra gates and the output policy (which events and branches the SortTree gets)
+ */
+string analysis::checkpointSettings() {
+  string settings = channels.signature();
+  settings += sicoinc.isEnabled() ? " coincidence" : " no coincidence";
+  settings += " "+extraGateNames();
+  settings += " | policy "+policy.signature();
+  return settings;
+}
+
+/*sortBranch
+ *A SortTree branch: made (if the output policy wants it) for a new tree, or pointed at its
+ *variable if the tree is the one of a checkpoint
+ */
+void analysis::sortBranch(const char* name, void *address, const char* leaflist, bool existing) {
+  if (!existing) policy.branch(sortTree, name, address, leaflist);
+  else if (sortTree->GetBranch(name)) sortTree->SetBranchAddress(name, address);
+}
+
+/*saveCheckpoint
+ *Checkpoint of the sort loop before entry: the histograms (fills flushed), the SortTree so
+ *far, the cuts and windows, the cut flow counts and which histograms are already complete
+ */
+void analysis::saveCheckpoint(int entry, TreeWriter *writer) {
+  Instrument::Timer t("checkpoint");
+  flushFills();
+  writer->sync();
+  cutflow.merge();
+  Checkpoint::State state;
+  state.cursor = entry;
+  state.treeEntries = sortTree->GetEntries();
+  state.flags = (rawFilled ? RAW_DONE : 0) | (tcleanFilled ? TCLEAN_DONE : 0);
+  for (UInt_t m=0; m<=CutFlow::ACCEPTED; m++) state.extra.push_back(cutflow.count(m));
+  TFile *storage = sortTree->GetCurrentFile();
+  storage->cd();
+  CutSet used;
+  getCuts(used);
+  used.writeWindows();
+  writeSortGates(storage);
+  checkpoint.save(storage, state, histoArray, sortTree);
+}
+
+/*resume
+ *Picks the sort up where the checkpoint left it: the saved histogram contents and cut flow
+ *counts are added back and the loop starts at the checkpoint's event. The sort_raw histograms
+ *are not taken from the checkpoint if this run has filled them already (during the ingest)
+ */
+void analysis::resume(const Checkpoint::State &state) {
+  TH1 *raw[] = {fp1_tsum, fp1_tdiff, fp1_tcheck, fp2_tsum, fp2_tdiff, fp2_tcheck, si_time};
+  vector<TH1*> histos;
+  for (int i=0; i<histoArray->GetEntries(); i++) {
+    TH1 *h = dynamic_cast<TH1*>(histoArray->At(i));
+    bool skip = (h == NULL);
+    for (int r=0; r<7 && rawFilled; r++) if (h == raw[r]) skip = true;
+    if (!skip) histos.push_back(h);
+  }
+  Checkpoint::restore(sortTree->GetCurrentFile(), histos);
+  if (state.flags & RAW_DONE) rawFilled = true;
+  tcleanFilled = (state.flags & TCLEAN_DONE);
+  for (unsigned int m=0; m<state.extra.size(); m++) cutflow.addCount(m, (Long64_t) state.extra[m]);
+  firstEntry = state.cursor;
+}
+
 /*sort_tclean
  *Takes tsum sorted data and now makes EdE x1_x2 and fp-anode
  *histograms for a final round of cuts
@@ -156,26 +612,14 @@ void analysis::sort_raw() {
 void analysis::sort_tclean() {
 
   TCanvas *c1 = new TCanvas();
-  for (int entry = 0; entry <nentries; entry++) {
-    vector<Int_t> mtdc = mtdc_v[entry];
-    if (notEmpty(mtdc[1]) && notEmpty(mtdc[2]) && notEmpty(mtdc[3]) && notEmpty(mtdc[4])) {
-      Float_t tdiff1 = tdiff1_v[entry]*1/1.83;
-      Float_t tdiff2 = tdiff2_v[entry]*1/1.969;
-      Float_t tcheck1 = tsum1_v[entry]/2.0-anode1_time_v[entry]*0.0625;
-      Float_t tcheck2 = tsum2_v[entry]/2.0-anode2_time_v[entry]*0.0625;
-      Float_t theta = (tdiff2-tdiff1)/36.0; //36 mm separation between wires     
-
-      if (TCheck1Check(tcheck1)){
-        if(notEmpty(anode1_v[entry])) { 
-          scint1_anode1->Fill(scint1_v[entry], anode1_v[entry]);
-          fp1_anode1->Fill(tdiff1, anode1_v[entry]);
-        }
-        x1_x2->Fill(tdiff1, tdiff2);
-        x1_theta->Fill(tdiff1, theta);
-      }
-      if (TCheck2Check(tcheck2)) {
-        fp2_anode2->Fill(tdiff2, anode2_v[entry]);
-      }
+  vector<DenseHist*> rest;
+  thread background;
+  if (sampleStride > 1) {
+    previewFill(tcleanSet, &analysis::fill_tclean, rest, background);
+  } else {
+    Instrument::Timer t("sort_tclean");
+    for (int entry = 0; entry <nentries; entry++) {
+      fill_tclean(entry, tcleanSet);
     }
   }
 
@@ -191,6 +635,7 @@ void analysis::sort_tclean() {
   s1a1_cut->SetVarY("anode1");
   histoArray->Add(s1a1_cut);*/
 
+  flushFills();
   x1_x2->Draw("colz");
   while(c1->WaitPrimitive()) {}
   x1x2_cut = (TCutG*)c1->GetPrimitive("CUTG");
@@ -216,18 +661,17 @@ void analysis::sort_tclean() {
   theta_cut->SetVarY("theta");
   histoArray->Add(theta_cut);*/
 
-  for(int i=0; i<nentries; i++) {
-    vector<Int_t> mtdc = mtdc_v[i];
-    Float_t tdiff1 = tdiff1_v[i]*1/1.86;
-    Float_t anode1 = anode1_v[i];
-    if(fp1anode1_cut->IsInside(tdiff1, anode1)) {
-      Float_t scint1_time = scint1_time_v[i]*0.0625;
-      fp1_plastic_time->Fill(tdiff1, scint1_time);
-      Float_t rf_scint_time_wrapped = fmod(mtdc[9]*0.0625-scint1_time,164.95);
-      fp1_rf_scint_wrapped->Fill(tdiff1, rf_scint_time_wrapped);
+  finishPreview(tcleanSet, rest, background);
+  if (sampleStride > 1) {
+    previewFill(timingSet, &analysis::fill_timing, rest, background);
+  } else {
+    Instrument::Timer t("sort_timing");
+    for(int i=0; i<nentries; i++) {
+      fill_timing(i, timingSet);
     }
   }
   
+  flushFills();
   fp1_plastic_time->Draw("colz");
   while(c1->WaitPrimitive()) {}
   fp1plast_cut = (TCutG*)c1->GetPrimitive("CUTG");
@@ -243,83 +687,197 @@ void analysis::sort_tclean() {
   fp1rfwrap_cut->SetVarX("x1");
   fp1rfwrap_cut->SetVarY("rf_scint_wrapped");
   histoArray->Add(fp1rfwrap_cut);
+  finishPreview(timingSet, rest, background);
   c1->Close();
 }
 
 /*sort_full
  *Takes data through the full range of cuts and produces
  *the majority of the histograms 
+ *SortTree is filled and compressed behind the loop by a TreeWriter
  */
 void analysis::sort_full() {
 
   GetWeights();
-  for (int entry = 0; entry < nentries; entry++) {
-    vector<Int_t> mtdc = mtdc_v[entry];
-    cutFlag_n = 0;
-    coincFlag_n = 0;
-    if (notEmpty(mtdc[1]) && notEmpty(mtdc[2]) && notEmpty(mtdc[3]) && notEmpty(mtdc[4])) {
-      tdiff1_n = tdiff1_v[entry]*1/1.83;
-      tdiff2_n = tdiff2_v[entry]*1/1.969;
-      tcheck1_n = tsum1_v[entry]/2.0-anode1_time_v[entry]*0.0625;
-      tcheck2_n = tsum2_v[entry]/2.0-anode2_time_v[entry]*0.0625;
-      tsum1_n = tsum1_v[entry];
-      tsum2_n = tsum2_v[entry];
-      x_avg_n = tdiff1_n*w1+tdiff2_n*w2;
-      theta_n = (tdiff2_n-tdiff1_n)/36.0;
-      y1_n = anode1_time_v[entry]-scint1_time_v[entry];
-      y2_n = anode2_time_v[entry]-scint1_time_v[entry];
-      scint1_time_n = (Float_t)scint1_time_v[entry]*0.0625;
-      rf_scint_wrapped_n = fmod(mtdc[9]*0.0625-scint1_time_n, 164.95);
-      scint1_n = scint1_v[entry];
-      anode1_n = anode1_v[entry];
-      anode2_n = anode2_v[entry];
-      phi_n = (y2_n-y1_n)/36.0;
-      if (TCheck1Check(tcheck1_n) && TCheck2Check(tcheck2_n)){
-     
-        if (//s1a1_cut->IsInside(scint1_n, anode1_n) && 
-            fp1plast_cut->IsInside(tdiff1_n, scint1_time_n)) {
-
-          fp1_tdiff_ts1a1gate->Fill(tdiff1_n);
-          fp1_anode_ts1a1gate->Fill(tdiff1_n, anode1_n);
-
-          if(x1x2_cut->IsInside(tdiff1_n,tdiff2_n) && fp1anode1_cut->IsInside(tdiff1_n,anode1_n)){
-
-            fp1_tdiff_all->Fill(tdiff1_n);
-            //if (theta_cut->IsInside(tdiff1_n, theta_n)) fp1_tdiff_all_closed->Fill(tdiff1_n);
-            fp1_tdiffsum->Fill(tdiff1_n, tsum1_n);
-            xdiff->Fill(theta_n);
-            xavg->Fill(x_avg_n);
-            fp1_y->Fill(y1_n);
-            phi_hist->Fill(phi_n);
-            cutFlag_n = 1;         
-          //Si scattering chamber coincidence GLORP
-           /* for (int i = 16; i<32; i++) {
-              if (SiTimeCheck(mtdc[i])){
-                fp1_tdiff_all_sitime->Fill(tdiff1_n);
-                coincFlag_n = 1;
-                if(theta_cut->IsInside(tdiff1_n,theta_n)) 
-                  fp1_tdiff_all_sitime_closed->Fill(tdiff1_n);
-                break;
-              }
-            }*/
-          ///////////////////////////////////////
-
-          }
-        }
-      }
-      sortTree->Fill();
+  buildGates(~0u); //every gate
+  rawFilled = tcleanFilled = true; //by the passes before
+  TreeWriter writer(sortTree);
+  Instrument::Timer t("sort_full");
+  if (checkpoint.isEnabled()) saveCheckpoint(firstEntry, &writer); //keeps the cuts just drawn
+  for (int entry = firstEntry; entry < nentries; entry++) {
+    if (entry%Checkpoint::CHECK_ENTRIES == 0 && checkpoint.due()) saveCheckpoint(entry, &writer);
+    fill_full(entry, fullSet, &writer);
+  }
+  flushFills();
+  t.stop();
+  Instrument::Timer w("tree_write");
+  writer.finish();
+  policy.addWriteTime(writer.fillSeconds()); //once for the stage, timed on the writer thread
+}
+
+/*writeCutFlow
+ *Adds up the gate counts of fill_full and writes the cut_flow and gate_pass histograms to the
+ *current directory, and the summary to summaryName (if not NULL)
+ */
+void analysis::writeCutFlow(const char* summaryName) {
+  cutflow.merge();
+  TH1D *flow = cutflow.flowHisto();
+  TH1D *pass = cutflow.passHisto();
+  flow->Write(flow->GetName(), TObject::kOverwrite);
+  pass->Write(pass->GetName(), TObject::kOverwrite);
+  delete flow;
+  delete pass;
+  if (summaryName) {
+    cutflow.print(cout);
+    cutflow.write(summaryName);
+  }
+}
+
+/*countGates
+ *Hands the numbers of events through each of the fill_full gates to the run report
+ */
+void analysis::countGates() {
+  cutflow.merge();
+  Instrument::count("events_sorted", cutflow.total());
+  for (int g=0; g<CutFlow::NGATES; g++) {
+    Instrument::count(Form("events_through_%s", CutFlow::gateName(g)), cutflow.through(g));
+  }
+}
+
+/*sort_fused
+ *All three sorts in one sweep over the events, used when the gates come from a cut file
+ *instead of being drawn. Every histogram and the SortTree get exactly the same fills in the
+ *same order as from sort_raw, sort_tclean and sort_full, but each event is loaded from memory
+ *once instead of in four separate loops
+ */
+void analysis::sort_fused() {
+
+  //estimated bytes of the storage vectors read per event by each step, counted from the columns
+  //each fill reads (not measured): the mtdc channels used (fp wires and rf, the start of the
+  //event's compact channel row) are counted as one 64 byte cache line, the gate columns not at all
+  const Long64_t rawBytes = 64+6*sizeof(Float_t); //tdiff, tsum, anode_time of both planes
+  const Long64_t tcleanBytes = 64+6*sizeof(Float_t)+3*sizeof(Int_t); //the same plus scint1, anode1, anode2
+  const Long64_t timingBytes = 64+2*sizeof(Float_t)+sizeof(Int_t); //tdiff1, scint1_time, anode1
+  const Long64_t fullBytes = 64+7*sizeof(Float_t)+3*sizeof(Int_t); //all of the above
+  const Long64_t fusedBytes = 64+7*sizeof(Float_t)+3*sizeof(Int_t); //union of the above
+
+  GetWeights();
+  buildGates(~0u); //every gate
+  TreeWriter writer(sortTree);
+  Instrument::Timer t("sort_fused");
+  auto start = chrono::steady_clock::now();
+  if (checkpoint.isEnabled()) saveCheckpoint(firstEntry, &writer);
+  for (int entry = firstEntry; entry < nentries; entry++) {
+    if (entry%Checkpoint::CHECK_ENTRIES == 0 && checkpoint.due()) saveCheckpoint(entry, &writer);
+    if (!rawFilled) fill_raw(entry, rawSet);
+    if (!tcleanFilled) {
+      fill_tclean(entry, tcleanSet);
+      fill_timing(entry, timingSet);
     }
+    fill_full(entry, fullSet, &writer);
   }
+  flushFills();
+  Double_t sweep = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+  t.stop();
+  Instrument::Timer w("tree_write");
+  writer.finish();
+  policy.addWriteTime(writer.fillSeconds()); //once for the stage, timed on the writer thread
+  w.stop();
+
+  Long64_t swept = nentries-firstEntry;
+  Double_t separate = (Double_t)swept*((rawFilled ? 0 : rawBytes)+(tcleanFilled ? 0 : tcleanBytes+timingBytes)+fullBytes)/1048576.0;
+  Double_t fused = (Double_t)swept*fusedBytes/1048576.0;
+  cout<<"Fused sort: "<<swept<<" events in "<<sweep<<" s"<<endl;
+  cout<<"  event data read (estimated from the columns read): "<<fused<<" MB in one pass vs "<<separate<<" MB in "
+      <<1+(rawFilled ? 0 : 1)+(tcleanFilled ? 0 : 2)<<" separate passes ("<<separate-fused<<" MB saved)"<<endl;
+  if (sweep > 0) cout<<"  "<<fused/sweep<<" MB/s"<<endl;
 }
 
-/*run
- *runs all three sorts in proper order
+/*applyCuts
+ *Takes the gates from a cut file instead of asking for them
  */
-void analysis::run(char* dataName, char* storageName) {
-  TFile *data = new TFile(dataName, "READ");
-  TFile *storage = new TFile(storageName, "RECREATE");
-  TTree *dataTree = (TTree*) data->Get("DataTree");
-  sortTree = new TTree("SortTree", "SortTree");
+void analysis::applyCuts(CutSet &cuts) {
+  min1 = cuts.min1; max1 = cuts.max1;
+  min2 = cuts.min2; max2 = cuts.max2;
+  minSi = cuts.minSi; maxSi = cuts.maxSi;
+  x1x2_cut = cuts.x1x2_cut;
+  fp1anode1_cut = cuts.fp1anode1_cut;
+  fp1plast_cut = cuts.fp1plast_cut;
+  fp1rfwrap_cut = cuts.fp1rfwrap_cut;
+  histoArray->Add(x1x2_cut);
+  histoArray->Add(fp1anode1_cut);
+  histoArray->Add(fp1plast_cut);
+  histoArray->Add(fp1rfwrap_cut);
+}
+
+/*saveCuts
+ *Saves the gates drawn in this run so that the next run can use them
+ */
+void analysis::saveCuts(char* fileName) {
+  CutSet cuts;
+  getCuts(cuts);
+  cuts.save(fileName);
+}
+
+/*getCuts
+ *The gates in use, as a CutSet
+ */
+void analysis::getCuts(CutSet &cuts) {
+  cuts.min1 = min1; cuts.max1 = max1;
+  cuts.min2 = min2; cuts.max2 = max2;
+  cuts.minSi = minSi; cuts.maxSi = maxSi;
+  cuts.x1x2_cut = x1x2_cut;
+  cuts.fp1anode1_cut = fp1anode1_cut;
+  cuts.fp1plast_cut = fp1plast_cut;
+  cuts.fp1rfwrap_cut = fp1rfwrap_cut;
+}
+
+/*writeSortGates
+ *The gates the SortTree's gateMask was made with, in the directory sort_gates of the
+ *histogram file: the cuts and windows, whether only accepted events were written and the
+ *gateMask bits an event needs for cutFlag (acceptMask, with the required extra gates) and
+ *the names of the extra gates in the order of their bits.
+ *regate compares its cuts with these; unlike the cuts next to the spectra they are never
+ *replaced by a re-gate
+ */
+void analysis::writeSortGates(TFile *storage) {
+  TDirectory *dir = storage->GetDirectory("sort_gates");
+  if (!dir) dir = storage->mkdir("sort_gates");
+  dir->cd();
+  CutSet used;
+  getCuts(used);
+  used.write();
+  TParameter<Int_t> accepted("acceptedOnly", policy.isAcceptedOnly() ? 1 : 0);
+  accepted.Write(0, TObject::kOverwrite);
+  TParameter<Long64_t> mask("acceptMask", acceptMask);
+  mask.Write(0, TObject::kOverwrite);
+  TNamed extra("extra_gates", extraGateNames().c_str());
+  extra.Write(0, TObject::kOverwrite);
+  storage->cd();
+}
+
+/*extraGateNames
+ *The extra gates (-G) in the order of their gateMask bits, separated by spaces
+ */
+string analysis::extraGateNames() {
+  vector<string> names = gateConfig.names();
+  string joined;
+  for (unsigned int i=0; i<names.size(); i++) joined += (i ? " " : "")+names[i];
+  return joined;
+}
+
+/*setCutFile
+ *Cut file for the run; if it exists its gates are used (fused sort, no drawing), if not the
+ *gates drawn in the run are saved to it
+ */
+void analysis::setCutFile(char* fileName) {
+  cutName = fileName;
+}
+
+/*makeHistograms
+ *Creates all of the analysis histograms and adds them to histoArray
+ */
+void analysis::makeHistograms() {
   histoArray = new TObjArray();
 
   fp1_tsum = new TH1F("fp1_tsum", "fp1 tsum", 8192, 0, 8191);
@@ -343,6 +901,8 @@ void analysis::run(char* dataName, char* storageName) {
   fp1_tdiffsum = new TH2F("fp1_tdiffsum", "fp1_tdiffsum", 600, -300,300,512,0,8191);
   fp1_tdiff_all_sitime = new TH1F("fp1_tdiff_all_sitime", "fp1 pos all w/coinc time", 1200, -300, 300);  
   fp1_tdiff_all_sitime_closed = new TH1F("fp1_tdiff_all_sitime_closed", "fp1 pos all w/coinc time & closed slits", 1200, -300, 300);  
+  fp1_tdiff_all_sirandom = new TH1F("fp1_tdiff_all_sirandom", "fp1 pos all w/random coinc time", 1200, -300, 300);
+  fp1_tdiff_all_sitime_sub = new TH1F("fp1_tdiff_all_sitime_sub", "fp1 pos all w/coinc time, randoms subtracted", 1200, -300, 300);
   phi_hist = new TH1F("phi", "phi", 8192, -4095, 4096);
   fp1_plastic_time = new TH2F("fp1_plastic_time","fp1_plastic_time",600,-300,300,600,0,8191);
   fp1_rf_scint_wrapped = new TH2F("fp1_rf_scint_wrapped","fp1_rf_scint_wrapped",600,-300,300,600,0,8191);
@@ -360,6 +920,10 @@ void analysis::run(char* dataName, char* storageName) {
   histoArray->Add(fp2_y);
   histoArray->Add(fp1_tdiff_all_sitime);
   histoArray->Add(fp1_tdiff_all_sitime_closed);
+  if (sicoinc.isEnabled()) {
+    histoArray->Add(fp1_tdiff_all_sirandom);
+    histoArray->Add(fp1_tdiff_all_sitime_sub);
+  }
   histoArray->Add(phi_hist);
   histoArray->Add(scint1_anode1);
   histoArray->Add(fp1_anode1);
@@ -374,63 +938,165 @@ void analysis::run(char* dataName, char* storageName) {
   histoArray->Add(fp1_plastic_time);
   histoArray->Add(fp1_rf_scint_wrapped);
 
-  dataTree->SetBranchAddress("anode1", &anode1_d);
-  dataTree->SetBranchAddress("anode2", &anode2_d);
-  dataTree->SetBranchAddress("scint1", &scint1_d);
-  dataTree->SetBranchAddress("scint2", &scint2_d);
-  dataTree->SetBranchAddress("fp_plane1_tdiff", &tdiff1_d);
-  dataTree->SetBranchAddress("fp_plane2_tdiff", &tdiff2_d);
-  dataTree->SetBranchAddress("fp_plane1_tsum", &tsum1_d);
-  dataTree->SetBranchAddress("fp_plane2_tsum", &tsum2_d);
-  dataTree->SetBranchAddress("mtdc1", &mtdc_d);
-  dataTree->SetBranchAddress("anode1_time", &anode1_time_d);
-  dataTree->SetBranchAddress("anode2_time", &anode1_time_d);
-  dataTree->SetBranchAddress("plastic_time", &scint1_time_d);
-
-  sortTree->Branch("x1", &tdiff1_n, "x1/F");
-  sortTree->Branch("x2", &tdiff2_n, "x2/F");
-  sortTree->Branch("tsum1", &tsum1_n, "tsum1/F");
-  sortTree->Branch("tsum2", &tsum2_n, "tsum2/F");
-  sortTree->Branch("tcheck2", &tcheck2_n, "tcheck2/F");
-  sortTree->Branch("tcheck1", &tcheck1_n, "tcheck1/F");
-  sortTree->Branch("theta", &theta_n, "theta/F");
-  sortTree->Branch("phi", &phi_n, "phi/F");
-  sortTree->Branch("y1", &y1_n, "y1/F");
-  sortTree->Branch("y2", &y2_n, "y2/F");
-  sortTree->Branch("anode1", &anode1_n, "anode1/I");
-  sortTree->Branch("anode2", &anode2_n, "anode2/I");
-  sortTree->Branch("scint", &scint1_n, "scint/I");
-  sortTree->Branch("rf_scint_wrapped", &rf_scint_wrapped_n,"rf_scint_wrapped/F");
-  sortTree->Branch("scint_time", &scint1_time_n,"scint_time/F");
-  sortTree->Branch("cutFlag", &cutFlag_n, "cutFlag/I");
-  sortTree->Branch("coincFlag", &coincFlag_n, "coincFlag/I");
+  //order as in the RawHisto, TcleanHisto, TimingHisto and FullHisto enums; all filled through the fast path
+  rawSet.add(fp1_tsum); rawSet.add(fp1_tdiff); rawSet.add(fp1_tcheck);
+  rawSet.add(fp2_tsum); rawSet.add(fp2_tdiff); rawSet.add(fp2_tcheck); rawSet.add(si_time);
+  tcleanSet.add(scint1_anode1); tcleanSet.add(fp1_anode1); tcleanSet.add(fp2_anode2);
+  tcleanSet.add(x1_x2); tcleanSet.add(x1_theta);
+  timingSet.add(fp1_plastic_time); timingSet.add(fp1_rf_scint_wrapped);
+  fullSet.add(fp1_tdiff_ts1a1gate); fullSet.add(fp1_anode_ts1a1gate); fullSet.add(fp1_tdiff_all);
+  fullSet.add(fp1_tdiffsum); fullSet.add(xdiff); fullSet.add(xavg); fullSet.add(fp1_y); fullSet.add(phi_hist);
+  fullSet.add(fp1_tdiff_all_sitime); fullSet.add(fp1_tdiff_all_sitime_closed); fullSet.add(fp1_tdiff_all_sirandom);
+  rawSet.useFast();
+  tcleanSet.useFast();
+  timingSet.useFast();
+  fullSet.useFast();
+}
 
-  nentries = dataTree->GetEntries();
-  cout<<"entries: "<<nentries<<endl;
-  mtdc_v.resize(nentries);
-  for (int entry = 0; entry<nentries; entry++) {
-    dataTree->GetEntry(entry);
-    mtdc_v[entry].resize(32);
-    anode1_v.push_back(anode1_d);
-    anode2_v.push_back(anode2_d);
-    scint2_v.push_back(scint2_d);
-    scint1_v.push_back(scint1_d);
-    tdiff1_v.push_back(tdiff1_d);
-    tdiff2_v.push_back(tdiff2_d);
-    tsum1_v.push_back(tsum1_d);
-    tsum2_v.push_back(tsum2_d);
-    scint1_time_v.push_back(scint1_time_d);
-    anode1_time_v.push_back(anode1_time_d);
-    anode2_time_v.push_back(anode2_time_d);
-    for (int i=0; i<32; i++) {
-      mtdc_v[entry][i] = (*mtdc_d)[i];
+/*setBranches
+ *Declares the raw DataTree branches (in the order of the RawColumn enum) with the branch
+ *variables they are read into, and checks them against the tree; false if the tree doesn't
+ *have them all with the right types
+ */
+bool analysis::setBranches(TTree *dataTree) {
+  schema.clear();
+  schema.add("anode1", &anode1_d);
+  schema.add("anode2", &anode2_d);
+  schema.add("scint1", &scint1_d);
+  schema.add("scint2", &scint2_d);
+  schema.add("fp_plane1_tdiff", &tdiff1_d);
+  schema.add("fp_plane2_tdiff", &tdiff2_d);
+  schema.add("fp_plane1_tsum", &tsum1_d);
+  schema.add("fp_plane2_tsum", &tsum2_d);
+  schema.add("mtdc1", &mtdc_d);
+  schema.add("anode1_time", &anode1_time_d);
+  schema.add("anode2_time", &anode2_time_d);
+  schema.add("plastic_time", &scint1_time_d);
+  return schema.open(dataTree);
+}
+
+/*monitor
+ *Monitor mode for use during a run: follows a DataTree that is still being written (the
+ *writer has to AutoSave it regularly) and processes only the new entries, with the saved cuts
+ *and, if the corrections have been done, the saved x|theta correction. The histograms,
+ *including x1_corr, are checkpointed to storageName every period seconds, so they can be
+ *looked at while the run goes on. Stops on ctrl-c after a last checkpoint.
+ */
+void analysis::monitor(char* dataName, char* storageName, char* corrName, int period) {
+  CutSet cuts;
+  if (!cutName || !cuts.load(cutName)) {
+    cout<<"Monitor mode needs saved cuts (-c cutfile)"<<endl;
+    return;
+  }
+  fit correction;
+  bool corrected = correction.loadCorrection(corrName);
+  if (!corrected) cout<<"No saved correction in "<<corrName<<", x1_corr will not be filled"<<endl;
+
+  TFile *storage = new TFile(storageName, "RECREATE");
+  makeHistograms();
+  TH1F *x1_corr = new TH1F("x1_corr", "fp1 pos corr", 1000, -300, 300);
+  histoArray->Add(x1_corr);
+  applyCuts(cuts);
+  GetWeights();
+  buildGates(~0u); //every gate
+
+  TFile *data = new TFile(dataName, "READ");
+  TTree *dataTree = (TTree*) data->Get("DataTree");
+  if (!dataTree) {
+    cout<<"No DataTree in "<<dataName<<" yet"<<endl;
+    data->Close();
+    storage->Close();
+    return;
+  }
+  if (!setBranches(dataTree)) {
+    cout<<dataName<<" doesn't have the expected DataTree branches"<<endl;
+    data->Close();
+    storage->Close();
+    return;
+  }
+
+  monitorStop = 0;
+  signal(SIGINT, stopMonitor);
+  Long64_t processed = 0, sinceCheckpoint = 0;
+  auto lastCheckpoint = chrono::steady_clock::now();
+  auto oldest = lastCheckpoint; //when the oldest event not yet checkpointed was seen
+  while (true) {
+    bool stopping = monitorStop;
+    dataTree->Refresh();
+    Long64_t available = dataTree->GetEntries();
+    if (available > processed) {
+      if (sinceCheckpoint == 0) oldest = chrono::steady_clock::now();
+      nentries = (available-processed < MONITOR_CHUNK) ? available-processed : MONITOR_CHUNK;
+      clearEvents();
+      for (int i=0; i<nentries; i++) {
+        schema.readEntry(processed+i);
+        storeEntry();
+      }
+      for (int entry=0; entry<nentries; entry++) {
+        fill_raw(entry, rawSet);
+        fill_tclean(entry, tcleanSet);
+        fill_timing(entry, timingSet);
+        fill_full(entry, fullSet, NULL);
+        if (corrected && cutFlag_n) x1_corr->Fill(correction.correctX(tdiff1_n, theta_n));
+      }
+      processed += nentries;
+      sinceCheckpoint += nentries;
+      Instrument::count("events_read", nentries);
+    } else if (!stopping) {
+      this_thread::sleep_for(chrono::milliseconds(500));
+    }
+    auto now = chrono::steady_clock::now();
+    if (stopping || chrono::duration<double>(now-lastCheckpoint).count() >= period) {
+      Instrument::Timer t("checkpoint");
+      flushFills();
+      finishCoinc();
+      storage->cd();
+      histoArray->Write(0, TObject::kOverwrite);
+      writeCutFlow(NULL);
+      storage->SaveSelf(kTRUE);
+      storage->Flush();
+      cout<<"Checkpoint: "<<processed<<" events ("<<sinceCheckpoint<<" new, "
+          <<sinceCheckpoint/chrono::duration<double>(now-lastCheckpoint).count()<<" /s)";
+      if (sinceCheckpoint > 0) {
+        cout<<", oldest new event "<<chrono::duration<double>(chrono::steady_clock::now()-oldest).count()<<" s old";
+      }
+      cout<<endl;
+      lastCheckpoint = now;
+      sinceCheckpoint = 0;
+      if (stopping) break;
     }
   }
-  
-  sort_raw();
-  sort_tclean();
-  sort_full();
+  signal(SIGINT, SIG_DFL);
+  countGates();
+  reportGates();
+  clearEvents();
+  data->Close();
+  storage->Close();
+}
 
+/*storeEntry
+ *Adds the event in the branch variables to the storage vectors
+ */
+void analysis::storeEntry() {
+  anode1_v.push_back(anode1_d);
+  anode2_v.push_back(anode2_d);
+  scint2_v.push_back(scint2_d);
+  scint1_v.push_back(scint1_d);
+  tdiff1_v.push_back(tdiff1_d);
+  tdiff2_v.push_back(tdiff2_d);
+  tsum1_v.push_back(tsum1_d);
+  tsum2_v.push_back(tsum2_d);
+  scint1_time_v.push_back(scint1_time_d);
+  anode1_time_v.push_back(anode1_time_d);
+  anode2_time_v.push_back(anode2_time_d);
+  mtdc_v.resize(mtdc_v.size()+nmtdc);
+  channels.gather(*mtdc_d, &mtdc_v[mtdc_v.size()-nmtdc]);
+}
+
+/*clearEvents
+ *Empties the storage vectors
+ */
+void analysis::clearEvents() {
   anode1_v.clear();
   anode2_v.clear();
   scint2_v.clear();
@@ -443,9 +1109,430 @@ void analysis::run(char* dataName, char* storageName) {
   scint1_time_v.clear();
   anode1_time_v.clear();
   anode2_time_v.clear();
+  gateFirst = gateEnd = 0;
+}
 
-  sortTree->Write(sortTree->GetName(), TObject::kOverwrite);
-  histoArray->Write();
+/*readBatches
+ *Producer side of the ingest pipeline, runs in its own thread: reads (decompresses) the
+ *DataTree entries into batches and queues them. Each batch is read a column at a time
+ */
+void analysis::readBatches(BatchQueue *queue) {
+  for (int first = 0; first<nentries; first += BATCH_ENTRIES) {
+    EventBatch *batch = queue->acquire();
+    int n = (nentries-first < BATCH_ENTRIES) ? nentries-first : BATCH_ENTRIES;
+    schema.readColumn(COL_ANODE1, first, n, &anode1_d, &batch->anode1[0]);
+    schema.readColumn(COL_ANODE2, first, n, &anode2_d, &batch->anode2[0]);
+    schema.readColumn(COL_SCINT1, first, n, &scint1_d, &batch->scint1[0]);
+    schema.readColumn(COL_SCINT2, first, n, &scint2_d, &batch->scint2[0]);
+    schema.readColumn(COL_TDIFF1, first, n, &tdiff1_d, &batch->tdiff1[0]);
+    schema.readColumn(COL_TDIFF2, first, n, &tdiff2_d, &batch->tdiff2[0]);
+    schema.readColumn(COL_TSUM1, first, n, &tsum1_d, &batch->tsum1[0]);
+    schema.readColumn(COL_TSUM2, first, n, &tsum2_d, &batch->tsum2[0]);
+    schema.readColumn(COL_ANODE1_TIME, first, n, &anode1_time_d, &batch->anode1_time[0]);
+    schema.readColumn(COL_ANODE2_TIME, first, n, &anode2_time_d, &batch->anode2_time[0]);
+    schema.readColumn(COL_PLASTIC_TIME, first, n, &scint1_time_d, &batch->scint1_time[0]);
+    for (int i=0; i<n; i++) {
+      schema.read(COL_MTDC, first+i);
+      channels.gather(*mtdc_d, &batch->mtdc[i*nmtdc]);
+    }
+    batch->n = n;
+    queue->push(batch);
+  }
+  queue->finish();
+}
+
+/*ingest
+ *Reads every event of the raw DataTree into the storage vectors
+ *The reading runs in a separate thread and hands over batches of events through a bounded
+ *queue; meanwhile this thread stores each batch and fills the sort_raw histograms, so that
+ *the reading overlaps with the analysis instead of being a separate pass
+ *Returns false, without reading anything, if the file has no DataTree with the expected branches
+ */
+bool analysis::ingest(char* dataName) {
+  Instrument::Timer t("ingest");
+  TFile *data = new TFile(dataName, "READ");
+  TTree *dataTree = (TTree*) data->Get("DataTree");
+  if (!dataTree || !setBranches(dataTree)) {
+    cout<<dataName<<" doesn't have a DataTree with the expected branches"<<endl;
+    data->Close();
+    return false;
+  }
+
+  nentries = dataTree->GetEntries();
+  cout<<"entries: "<<nentries<<endl;
+  anode1_v.reserve(nentries);
+  anode2_v.reserve(nentries);
+  scint2_v.reserve(nentries);
+  scint1_v.reserve(nentries);
+  tdiff1_v.reserve(nentries);
+  tdiff2_v.reserve(nentries);
+  tsum1_v.reserve(nentries);
+  tsum2_v.reserve(nentries);
+  scint1_time_v.reserve(nentries);
+  anode1_time_v.reserve(nentries);
+  anode2_time_v.reserve(nentries);
+  mtdc_v.reserve(nentries*nmtdc);
+
+  BatchQueue queue(QUEUE_SLOTS, BATCH_ENTRIES, nmtdc);
+  thread reader(&analysis::readBatches, this, &queue);
+  EventBatch *batch;
+  while ((batch = queue.pop()) != NULL) {
+    int first = anode1_v.size();
+    int n = batch->n;
+    anode1_v.insert(anode1_v.end(), batch->anode1.begin(), batch->anode1.begin()+n);
+    anode2_v.insert(anode2_v.end(), batch->anode2.begin(), batch->anode2.begin()+n);
+    scint1_v.insert(scint1_v.end(), batch->scint1.begin(), batch->scint1.begin()+n);
+    scint2_v.insert(scint2_v.end(), batch->scint2.begin(), batch->scint2.begin()+n);
+    tdiff1_v.insert(tdiff1_v.end(), batch->tdiff1.begin(), batch->tdiff1.begin()+n);
+    tdiff2_v.insert(tdiff2_v.end(), batch->tdiff2.begin(), batch->tdiff2.begin()+n);
+    tsum1_v.insert(tsum1_v.end(), batch->tsum1.begin(), batch->tsum1.begin()+n);
+    tsum2_v.insert(tsum2_v.end(), batch->tsum2.begin(), batch->tsum2.begin()+n);
+    scint1_time_v.insert(scint1_time_v.end(), batch->scint1_time.begin(), batch->scint1_time.begin()+n);
+    anode1_time_v.insert(anode1_time_v.end(), batch->anode1_time.begin(), batch->anode1_time.begin()+n);
+    anode2_time_v.insert(anode2_time_v.end(), batch->anode2_time.begin(), batch->anode2_time.begin()+n);
+    mtdc_v.insert(mtdc_v.end(), batch->mtdc.begin(), batch->mtdc.begin()+n*nmtdc);
+    queue.release(batch);
+    for (int entry = first; entry<first+n; entry++) {
+      fill_raw(entry, rawSet);
+    }
+  }
+  reader.join();
+  flushFills();
+  queue.report();
+  rawFilled = true;
   data->Close();
+  return true;
+}
+
+/*setupCache
+ *Registers the storage vectors (the raw branches used by the sorts) as event cache columns
+ */
+void analysis::setupCache(EventCache &cache) {
+  cache.addColumn("anode1", &anode1_v);
+  cache.addColumn("anode2", &anode2_v);
+  cache.addColumn("scint1", &scint1_v);
+  cache.addColumn("scint2", &scint2_v);
+  cache.addColumn("fp_plane1_tdiff", &tdiff1_v);
+  cache.addColumn("fp_plane2_tdiff", &tdiff2_v);
+  cache.addColumn("fp_plane1_tsum", &tsum1_v);
+  cache.addColumn("fp_plane2_tsum", &tsum2_v);
+  cache.addColumn(channels.signature().c_str(), &mtdc_v, nmtdc); //cache rebuilt if the map changes
+  cache.addColumn("anode1_time", &anode1_time_v);
+  cache.addColumn("anode2_time", &anode2_time_v);
+  cache.addColumn("plastic_time", &scint1_time_v);
+}
+
+/*loadPolicy
+ *Output policy for the SortTree (see OutputPolicy.h); without one everything is written
+ */
+void analysis::loadPolicy(char* policyName) {
+  policy.load(policyName);
+}
+
+/*run
+ *runs all three sorts in proper order, or the fused sort if there is a cut file
+ *The raw data comes from the event cache if there is an up to date one for this data file,
+ *otherwise it is read from the DataTree and the cache is written for next time
+ */
+void analysis::run(char* dataName, char* storageName, char* cacheName) {
+  Checkpoint::State state;
+  CutSet resumeCuts;
+  bool resuming = false;
+  if (checkpoint.isEnabled()) {
+    checkpoint.setSource(dataName, checkpointSettings());
+    resuming = checkpoint.find(storageName, "SortTree", state);
+    if (resuming && state.complete) {
+      cout<<storageName<<" is already sorted (its checkpoint is complete)"<<endl;
+      return;
+    }
+    if (resuming) resuming = resumeCuts.load(storageName);
+    if (resuming) cout<<"Resuming the sort at event "<<state.cursor<<" from the checkpoint in "<<storageName<<endl;
+  }
+  TFile *storage = new TFile(storageName, resuming ? "UPDATE" : "RECREATE");
+  policy.require("x1"); //used by fit
+  policy.require("theta");
+  policy.require("gateMask");
+  policy.apply(storage);
+  if (resuming) sortTree = (TTree*) storage->Get("SortTree");
+  else sortTree = new TTree("SortTree", "SortTree");
+  policy.apply(sortTree);
+  //ROOT's own AutoSave would write a tree header past the last checkpoint record, which then
+  //doesn't match its tree; only Checkpoint::save writes it
+  if (checkpoint.isEnabled()) sortTree->SetAutoSave(0);
+  makeHistograms();
+
+  sortBranch("x1", &tdiff1_n, "x1/F", resuming);
+  sortBranch("x2", &tdiff2_n, "x2/F", resuming);
+  sortBranch("tsum1", &tsum1_n, "tsum1/F", resuming);
+  sortBranch("tsum2", &tsum2_n, "tsum2/F", resuming);
+  sortBranch("tcheck2", &tcheck2_n, "tcheck2/F", resuming);
+  sortBranch("tcheck1", &tcheck1_n, "tcheck1/F", resuming);
+  sortBranch("theta", &theta_n, "theta/F", resuming);
+  sortBranch("phi", &phi_n, "phi/F", resuming);
+  sortBranch("y1", &y1_n, "y1/F", resuming);
+  sortBranch("y2", &y2_n, "y2/F", resuming);
+  sortBranch("anode1", &anode1_n, "anode1/I", resuming);
+  sortBranch("anode2", &anode2_n, "anode2/I", resuming);
+  sortBranch("scint", &scint1_n, "scint/I", resuming);
+  sortBranch("rf_scint_wrapped", &rf_scint_wrapped_n, "rf_scint_wrapped/F", resuming);
+  sortBranch("scint_time", &scint1_time_n, "scint_time/F", resuming);
+  sortBranch("gateMask", &gateMask_n, "gateMask/i", resuming);
+  sortBranch("coincFlag", &coincFlag_n, "coincFlag/I", resuming);
+
+  EventCache cache;
+  setupCache(cache);
+  Instrument::Timer read("cache_read");
+  bool cached = cache.read(cacheName, dataName);
+  read.stop();
+  if (cached) {
+    nentries = cache.GetEntries();
+    cout<<"entries: "<<nentries<<" (from event cache "<<cacheName<<")"<<endl;
+  } else {
+    if (!ingest(dataName)) {
+      storage->Close();
+      return;
+    }
+    Instrument::Timer t("cache_write");
+    cache.write(cacheName, dataName, nentries);
+  }
+  Instrument::count("events_read", nentries);
+  storage->cd();
+
+  CutSet cuts;
+  if (resuming) {
+    applyCuts(resumeCuts);
+    resume(state);
+    sort_fused();
+  } else if (cutName && cuts.load(cutName)) {
+    cout<<"Using the cuts from "<<cutName<<endl;
+    applyCuts(cuts);
+    sort_fused();
+  } else {
+    sort_raw();
+    sort_tclean();
+    if (cutName) saveCuts(cutName); //before the long part, so a restarted job has them
+    sort_full();
+  }
+
+  clearEvents();
+  finishCoinc();
+
+  Instrument::Timer t("histo_write");
+  CutSet used;
+  getCuts(used);
+  used.writeWindows(); //with the cuts in histoArray
+  writeSortGates(storage); //for regate
+  auto start = chrono::steady_clock::now();
+  sortTree->Write(sortTree->GetName(), TObject::kOverwrite);
+  policy.addWriteTime(chrono::duration<double>(chrono::steady_clock::now()-start).count());
+  histoArray->Write(0, TObject::kOverwrite); //over the checkpointed ones
+  string summary = storageName;
+  if (summary.size() > 5 && summary.compare(summary.size()-5, 5, ".root") == 0) summary.erase(summary.size()-5);
+  summary += "_cutflow.txt";
+  writeCutFlow(summary.c_str());
+  countGates();
+  reportGates();
+  t.stop();
+  if (Instrument::isEnabled()) {
+    //the fills are the histogram entries, so they cost nothing to count
+    Long64_t fills = 0;
+    for (int i=0; i<histoArray->GetEntries(); i++) {
+      TH1 *h = dynamic_cast<TH1*>(histoArray->At(i));
+      if (h) fills += (Long64_t) h->GetEntries();
+    }
+    Instrument::count("histogram_fills", fills);
+    Instrument::count("sorttree_entries", sortTree->GetEntries());
+    Instrument::count("sorttree_zip_bytes", sortTree->GetZipBytes());
+    Instrument::count("histo_file_bytes", storage->GetEND());
+  }
+  policy.report(sortTree, storage);
+  if (checkpoint.isEnabled()) {
+    state.cursor = nentries;
+    state.treeEntries = sortTree->GetEntries();
+    state.complete = true;
+    state.extra.clear();
+    checkpoint.save(storage, state, NULL, NULL);
+  }
+  storage->Close();
+}
+
+/*regate
+ *Remakes the gated spectra of sort_full (fp1_tdiff_ts1a1gate ... phi) from the SortTree of a
+ *histogram file, with the cuts from the cut file and the gates listed in gates ("all", or
+ *names as in CutFlow.h separated by commas) instead of sorting the raw data again.
+ *Each event's gate decisions are in its gateMask, made with the gates saved in sort_gates
+ *(writeSortGates): only the gates whose cut or window differs from those are evaluated again
+ *(the gate predicate compiled for just those, over blocks of SortTree events), the others are
+ *taken from the mask. Without sort_gates (older files) the cuts next to the spectra are the
+ *sort's if the file was never re-gated, otherwise every gate is evaluated again. Extra
+ *gates (-G) are always taken from the mask, and the required ones are required here too.
+ *The gated spectra, cuts and cut flow in the histogram file are replaced, and a GateTree with
+ *the new gateMask and cutFlag of every SortTree event is added for the aberration correction.
+ *The silicon coincidence spectra (fp1_tdiff_all_sitime ...) are not remade: the SortTree
+ *doesn't have the mtdc hits, so they stay as the sort made them, with the sort's gates
+ */
+void analysis::regate(char* storageName, char* gateList) {
+  UInt_t required = CutFlow::parseGates(gateList);
+  if (!required) return;
+  required |= CutFlow::bit(CutFlow::WIRES); //SortTree events all have wires
+  CutSet cuts, old;
+  if (!cutName || !cuts.load(cutName)) {
+    cout<<"Re-gating needs a cut file (-c cutfile)"<<endl;
+    return;
+  }
+
+  TFile *storage = new TFile(storageName, "UPDATE");
+  TTree *tree = (TTree*) storage->Get("SortTree");
+  if (!tree || !tree->GetBranch("gateMask")) {
+    cout<<storageName<<" has no SortTree with a gateMask, it has to be sorted again"<<endl;
+    storage->Close();
+    return;
+  }
+
+  //the gates the stored gateMask was made with
+  bool sortKnown = false, acceptedOnly = false;
+  TDirectory *sortGates = storage->GetDirectory("sort_gates");
+  if (sortGates) {
+    sortKnown = old.load(sortGates, storageName);
+    TParameter<Int_t> *accepted = (TParameter<Int_t>*) sortGates->Get("acceptedOnly");
+    acceptedOnly = (accepted && accepted->GetVal());
+  } else if (!storage->Get("GateTree")) {
+    sortKnown = old.load(storage, storageName); //never re-gated, the saved cuts are the sort's
+  }
+  //the extra gate bits of the stored gateMask have to be the ones of this -G file
+  TNamed *sortExtra = sortGates ? (TNamed*) sortGates->Get("extra_gates") : NULL;
+  string extra = extraGateNames();
+  if ((sortExtra && extra != sortExtra->GetTitle()) || (!sortExtra && !extra.empty())) {
+    cout<<storageName<<" was sorted with the extra gates ("<<(sortExtra ? sortExtra->GetTitle() : "unknown")
+        <<"), not with those of the -G file ("<<extra<<"); give the same -G file as the sort, or sort again"<<endl;
+    storage->Close();
+    return;
+  }
+  UInt_t redo = CutFlow::ACCEPTED & ~CutFlow::bit(CutFlow::WIRES);
+  if (sortKnown) {
+    redo = 0;
+    if (cuts.min1 != old.min1 || cuts.max1 != old.max1) redo |= CutFlow::bit(CutFlow::TCHECK1);
+    if (cuts.min2 != old.min2 || cuts.max2 != old.max2) redo |= CutFlow::bit(CutFlow::TCHECK2);
+    if (!CutSet::sameCut(cuts.fp1plast_cut, old.fp1plast_cut)) redo |= CutFlow::bit(CutFlow::FP1PLAST);
+    if (!CutSet::sameCut(cuts.x1x2_cut, old.x1x2_cut)) redo |= CutFlow::bit(CutFlow::X1X2);
+    if (!CutSet::sameCut(cuts.fp1anode1_cut, old.fp1anode1_cut)) redo |= CutFlow::bit(CutFlow::FP1ANODE1);
+  } else {
+    cout<<"The gates "<<storageName<<" was sorted with aren't known, evaluating every gate again"<<endl;
+  }
+  if (acceptedOnly && (redo || (required & CutFlow::ACCEPTED) != CutFlow::ACCEPTED)) {
+    cout<<"Warning: the SortTree of "<<storageName<<" only has the events accepted by the sort (acceptedOnly);"<<endl
+        <<"  events outside the sort's gates were never written, so a looser gate or fewer required"<<endl
+        <<"  gates can't bring them back (sort again for that)"<<endl;
+  }
+
+  //variables of the spectra, plus those of the gates to evaluate again
+  vector<string> names = {"x1", "x2", "tsum1", "theta", "phi", "y1", "anode1", "gateMask"};
+  if (redo & CutFlow::bit(CutFlow::TCHECK1)) names.push_back("tcheck1");
+  if (redo & CutFlow::bit(CutFlow::TCHECK2)) names.push_back("tcheck2");
+  if (redo & CutFlow::bit(CutFlow::FP1PLAST)) names.push_back("scint_time");
+  tree->SetBranchStatus("*", 0);
+  for (unsigned int i=0; i<names.size(); i++) {
+    if (!tree->GetBranch(names[i].c_str())) {
+      cout<<"The SortTree has no "<<names[i]<<" branch (see the output policy), can't re-gate"<<endl;
+      storage->Close();
+      return;
+    }
+    tree->SetBranchStatus(names[i].c_str(), 1);
+  }
+  tree->SetBranchAddress("x1", &tdiff1_n);
+  tree->SetBranchAddress("x2", &tdiff2_n);
+  tree->SetBranchAddress("tsum1", &tsum1_n);
+  tree->SetBranchAddress("theta", &theta_n);
+  tree->SetBranchAddress("phi", &phi_n);
+  tree->SetBranchAddress("y1", &y1_n);
+  tree->SetBranchAddress("anode1", &anode1_n);
+  tree->SetBranchAddress("gateMask", &gateMask_n);
+  if (redo & CutFlow::bit(CutFlow::TCHECK1)) tree->SetBranchAddress("tcheck1", &tcheck1_n);
+  if (redo & CutFlow::bit(CutFlow::TCHECK2)) tree->SetBranchAddress("tcheck2", &tcheck2_n);
+  if (redo & CutFlow::bit(CutFlow::FP1PLAST)) tree->SetBranchAddress("scint_time", &scint1_time_n);
+
+  cout<<"Re-gating "<<tree->GetEntries()<<" events; evaluating again:";
+  for (int g=0; g<CutFlow::NGATES; g++) if (redo & (1u<<g)) cout<<" "<<CutFlow::gateName(g);
+  if (!redo) cout<<" none";
+  cout<<endl;
+
+  makeHistograms();
+  applyCuts(cuts);
+  GetWeights();
+  buildGates(redo);
+  required |= gates.required();
+
+  //SortTree variables the gates can be evaluated from, read a block of events at a time
+  const int NVARS = 10;
+  const char* varNames[NVARS] = {"x1", "x2", "tsum1", "theta", "phi", "y1", "anode1", "tcheck1", "tcheck2", "scint_time"};
+  vector<vector<Float_t> > block(NVARS, vector<Float_t>(GATE_BATCH));
+  vector<Int_t> anodes(GATE_BATCH);
+  vector<UInt_t> stored(GATE_BATCH), masks(GATE_BATCH);
+  const vector<string> &vars = gates.variables();
+  vector<const Float_t*> columns(vars.size());
+  for (unsigned int v=0; v<vars.size(); v++) {
+    int k = 0;
+    while (k < NVARS && vars[v] != varNames[k]) k++;
+    if (k == NVARS) {
+      cout<<"The gate variable "<<vars[v]<<" is not in the SortTree, can't re-gate"<<endl;
+      storage->Close();
+      return;
+    }
+    columns[v] = &block[k][0];
+  }
+  TTree *gateTree = new TTree("GateTree", "gates of the SortTree events after re-gating");
+  gateTree->Branch("gateMask", &gateMask_n, "gateMask/i");
+  gateTree->Branch("cutFlag", &cutFlag_n, "cutFlag/I");
+
+  Instrument::Timer t("regate");
+  Long64_t n = tree->GetEntries();
+  for (Long64_t first=0; first<n; first += GATE_BATCH) {
+    int m = (n-first < GATE_BATCH) ? n-first : GATE_BATCH;
+    for (int i=0; i<m; i++) {
+      tree->GetEntry(first+i);
+      const Float_t values[NVARS] = {tdiff1_n, tdiff2_n, tsum1_n, theta_n, phi_n, y1_n, (Float_t)anode1_n,
+                                     tcheck1_n, tcheck2_n, scint1_time_n};
+      for (int k=0; k<NVARS; k++) block[k][i] = values[k];
+      anodes[i] = anode1_n;
+      stored[i] = gateMask_n;
+    }
+    gates.evaluate(m, columns.empty() ? NULL : &columns[0], &stored[0], &masks[0]);
+    for (int i=0; i<m; i++) {
+      tdiff1_n = block[0][i]; tdiff2_n = block[1][i]; tsum1_n = block[2][i];
+      theta_n = block[3][i]; phi_n = block[4][i]; y1_n = block[5][i];
+      anode1_n = anodes[i];
+      gateMask_n = masks[i];
+      cutFlag_n = 0;
+      x_avg_n = tdiff1_n*w1+tdiff2_n*w2;
+      fill_gated(gateMask_n, required, fullSet);
+      gateCount->add(gateMask_n);
+      gateTree->Fill();
+    }
+  }
+  flushFills();
+  t.stop();
+  Instrument::count("events_regated", n);
+
+  storage->cd();
+  fp1_tdiff_ts1a1gate->Write(0, TObject::kOverwrite);
+  fp1_anode_ts1a1gate->Write(0, TObject::kOverwrite);
+  fp1_tdiff_all->Write(0, TObject::kOverwrite);
+  fp1_tdiffsum->Write(0, TObject::kOverwrite);
+  xdiff->Write(0, TObject::kOverwrite);
+  xavg->Write(0, TObject::kOverwrite);
+  fp1_y->Write(0, TObject::kOverwrite);
+  phi_hist->Write(0, TObject::kOverwrite);
+  x1x2_cut->Write(0, TObject::kOverwrite);
+  fp1anode1_cut->Write(0, TObject::kOverwrite);
+  fp1plast_cut->Write(0, TObject::kOverwrite);
+  fp1rfwrap_cut->Write(0, TObject::kOverwrite);
+  cuts.writeWindows();
+  gateTree->Write(gateTree->GetName(), TObject::kOverwrite);
+  string summary = storageName;
+  if (summary.size() > 5 && summary.compare(summary.size()-5, 5, ".root") == 0) summary.erase(summary.size()-5);
+  summary += "_cutflow.txt";
+  writeCutFlow(summary.c_str());
+  countGates();
+  reportGates();
   storage->Close();
 }
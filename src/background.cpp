@@ -10,6 +10,7 @@
  */
 
 #include "background.h"
+#include "Instrument.h"
 
 Backgnd::Backgnd() {
 
@@ -21,9 +22,11 @@ void Backgnd::run(char* inputname, char* outputname) {
   rawHisto = (TH1F*) inputFile->Get("x1_corr"); //Pulls corrected position spectrum
   cleanHisto = new TH1F("x1_corr_nobckgnd","x1_corr_nobckgnd", 1000, -300, 300);
 
+  Instrument::Timer t("background");
   TSpectrum *s = new TSpectrum(100);
   backgndHisto = s->Background(rawHisto); //If choppy: Background(rawHisto, numIterations) 
   cleanHisto->Add(rawHisto, backgndHisto, 1, -1);
+  t.stop();
 
   rawHisto->Write();
   backgndHisto->Write();
@@ -4,6 +4,8 @@
  *  The base constructor gives 5 polynomials, can override to give as many as needed
  *  G.M. Feb 2019
  *  Revised March 2019 to run without reopening and closing files as shown by KGH -- G.M.
+ *  Tilt and fit cuts can be saved to/loaded from the cut file -- G.M. Aug 2019
+ *  Checkpoints of the correction loop -- G.M. Aug 2019
  */
 
 #include "fit.h"
@@ -11,6 +13,10 @@
 #include <iostream>
 #include <string>
 #include "TMath.h"
+#include "TreeWriter.h"
+#include "Instrument.h"
+#include "CutFlow.h"
+#include "TParameter.h"
 #include <string>
 
 using namespace std;
@@ -18,7 +24,8 @@ using namespace std;
 fit::fit() :
   tilt_space(new TCutG("tilt_space", 0)),
   tilt(new TF1("tilt", "pol1")),
-  nfuncs(5) //default is 5 polynomials
+  nfuncs(5), //default is 5 polynomials
+  cutName(NULL), cutsLoaded(false), checkpoint("correct"), firstEntry(0)
 {
   f = new TF1*[nfuncs];
   f_space = new TCutG*[nfuncs];
@@ -36,7 +43,8 @@ fit::fit() :
 fit::fit(int n) : //n is number of fits
   tilt_space(new TCutG("tilt_space", 0)),
   tilt(new TF1("tilt", "pol1")),
-  nfuncs(n)
+  nfuncs(n),
+  cutName(NULL), cutsLoaded(false), checkpoint("correct"), firstEntry(0)
 {
   f = new TF1*[nfuncs];
   f_space = new TCutG*[nfuncs];
@@ -58,6 +66,7 @@ fit::fit(int n) : //n is number of fits
  */
 void fit::cut() {
  
+  if (cutsLoaded) return;
   cout<<"Draw "<< nfuncs << " fit cuts"<< endl;
   for (int i=0; i<nfuncs; i++) {
     cout<<i+1<<endl;
@@ -106,11 +115,13 @@ Float_t fit::interp(Float_t x, Float_t theta) {
  */
 void fit::untilt() {
 
-  cout<<"Draw tilt cut"<<endl;
-  h->Draw("colz");
-  while(c1->WaitPrimitive()) {}
-  tilt_space = (TCutG*) c1->GetPrimitive("CUTG");
-  tilt_space->SetName("tilt_space");
+  if (!cutsLoaded) {
+    cout<<"Draw tilt cut"<<endl;
+    h->Draw("colz");
+    while(c1->WaitPrimitive()) {}
+    tilt_space = (TCutG*) c1->GetPrimitive("CUTG");
+    tilt_space->SetName("tilt_space");
+  }
  
   vector<Float_t> ft_set;
   vector<Float_t> thetat_set;
@@ -125,6 +136,7 @@ void fit::untilt() {
   TGraph *x1_theta_fit_t = new TGraph(ft_set.size(), &(ft_set[0]), &(thetat_set[0]));
   x1_theta_fit_t->Fit(tilt);
 
+  Instrument::Timer t("fit_untilt");
   for (int entry = 0; entry < nentries; entry++) {
     theta_v[entry] = theta_v[entry]-tilt->Eval(x1_v[entry]);
     if (cutFlag_v[entry]) {
@@ -141,6 +153,7 @@ void fit::untilt() {
  *the inerpolated position from the polynomials
  *from the actual position of each datum
  *Corrected data is then filled into histograms and the corrected tree
+ *(the tree is filled and compressed behind the loop by a TreeWriter)
  */
 void fit::correct() {
 
@@ -165,15 +178,173 @@ void fit::correct() {
     histoArray->Add(x1_theta_fit[i]);
   }
 
-  for (int entry = 0; entry < nentries; entry++) {
+  TreeWriter writer(correctTree);
+  Instrument::Timer t("fit_correct");
+  if (checkpoint.isEnabled()) saveCheckpoint(firstEntry, &writer); //keeps the cuts just drawn
+  for (int entry = firstEntry; entry < nentries; entry++) {
+    if (entry%Checkpoint::CHECK_ENTRIES == 0 && checkpoint.due()) saveCheckpoint(entry, &writer);
     if (cutFlag_v[entry]) {
       x1_c = x1_v[entry] - interp(x1_v[entry], theta_v[entry]); 
       theta_c = theta_v[entry];
       x1_theta_c->Fill(x1_c, theta_c);
       x1_corrected->Fill(x1_c);
-      correctTree->Fill();
+      writer.Fill();
     }
   }   
+  writer.finish();
+  Instrument::count("fit_events_corrected", correctTree->GetEntries());
+}
+
+/*saveCorrection
+ *Writes the correction (tilt line, polynomials and their centers) to the current file, so
+ *that it can be applied later without redoing the fits (see loadCorrection)
+ */
+void fit::saveCorrection() {
+  tilt->Write("tilt", TObject::kOverwrite);
+  TVectorD centers(nfuncs);
+  for (int i=0; i<nfuncs; i++) {
+    f[i]->Write(Form("f%d", i), TObject::kOverwrite);
+    centers[i] = c[i];
+  }
+  centers.Write("poly_centers", TObject::kOverwrite);
+}
+
+/*loadCorrection
+ *Reads a correction saved by run from a corrected file; false if there isn't one
+ */
+bool fit::loadCorrection(char* corrName) {
+  TDirectory *current = gDirectory;
+  TFile *file = TFile::Open(corrName, "READ");
+  if (!file || file->IsZombie()) {
+    current->cd();
+    return false;
+  }
+  TVectorD *centers = (TVectorD*) file->Get("poly_centers");
+  TF1 *savedTilt = (TF1*) file->Get("tilt");
+  if (!centers || !savedTilt) {
+    file->Close();
+    current->cd();
+    return false;
+  }
+  tilt = (TF1*) savedTilt->Clone("tilt");
+  nfuncs = centers->GetNrows();
+  f = new TF1*[nfuncs];
+  c.resize(nfuncs);
+  for (int i=0; i<nfuncs; i++) {
+    TF1 *poly = (TF1*) file->Get(Form("f%d", i));
+    if (!poly) {
+      nfuncs = i;
+      file->Close();
+      current->cd();
+      return false;
+    }
+    f[i] = (TF1*) poly->Clone(Form("f%d", i));
+    c[i] = (*centers)[i];
+  }
+  file->Close();
+  current->cd();
+  return true;
+}
+
+/*correctX
+ *Applies a loaded correction to one event: untilts theta and subtracts the interpolated
+ *aberration, the same as untilt and correct do for the whole data set
+ */
+Float_t fit::correctX(Float_t x1, Float_t theta) {
+  Float_t theta_untilted = theta-tilt->Eval(x1);
+  return x1-interp(x1, theta_untilted);
+}
+
+/*setCutFile
+ *The tilt and fit cuts are taken from this file if it has them (nothing is drawn), otherwise
+ *they are drawn and added to it. It is the same file as the analysis cuts (see CutSet.h)
+ */
+void fit::setCutFile(char* fileName) {
+  cutName = fileName;
+}
+
+/*savedFits
+ *Number of fit cuts (polynomials) saved in a cut file, 0 if it has none or no tilt cut
+ */
+int fit::savedFits(char* fileName) {
+  TDirectory *current = gDirectory;
+  TFile *file = TFile::Open(fileName, "READ");
+  if (!file || file->IsZombie()) {
+    current->cd();
+    return 0;
+  }
+  int n = 0;
+  if (file->Get("tilt_space")) {
+    while (file->Get(Form("f_space%d", n))) n++;
+  }
+  file->Close();
+  current->cd();
+  return n;
+}
+
+/*setCheckpoint
+ *Checkpoints the correction every period seconds, and resumes it from the last checkpoint in
+ *the output file if there is one
+ */
+void fit::setCheckpoint(int period) {
+  checkpoint.setPeriod(period);
+}
+
+/*saveCheckpoint
+ *Checkpoint of the correction loop before entry: the cuts, the corrected histograms and the
+ *correctTree so far. The fits are remade from the cuts when resuming
+ */
+void fit::saveCheckpoint(int entry, TreeWriter *writer) {
+  Instrument::Timer t("checkpoint");
+  writer->sync();
+  TObjArray saved;
+  saved.Add(tilt_space);
+  for (int i=0; i<nfuncs; i++) saved.Add(f_space[i]);
+  saved.Add(x1_theta_c);
+  saved.Add(x1_corrected);
+  Checkpoint::State state;
+  state.cursor = entry;
+  state.treeEntries = correctTree->GetEntries();
+  checkpoint.save(correctTree->GetCurrentFile(), state, &saved, correctTree);
+}
+
+/*loadCuts
+ *Takes the tilt cut and the nfuncs fit cuts from a cut file; false if any are missing
+ */
+bool fit::loadCuts(char* fileName) {
+  if (savedFits(fileName) < nfuncs) return false;
+  TDirectory *current = gDirectory;
+  TFile *file = TFile::Open(fileName, "READ");
+  delete tilt_space; //the empty ones from the constructor
+  tilt_space = (TCutG*) file->Get("tilt_space")->Clone("tilt_space");
+  for (int i=0; i<nfuncs; i++) {
+    delete f_space[i];
+    f_space[i] = (TCutG*) file->Get(Form("f_space%d", i))->Clone(Form("f_space%d", i));
+  }
+  file->Close();
+  current->cd();
+  cout<<"Using the tilt and "<<nfuncs<<" fit cuts from "<<fileName<<endl;
+  return true;
+}
+
+/*saveCuts
+ *Adds the drawn tilt and fit cuts to the cut file
+ */
+void fit::saveCuts() {
+  TDirectory *current = gDirectory;
+  TFile *file = new TFile(cutName, "UPDATE");
+  if (file->IsZombie()) {
+    cout<<"Unable to save fit cuts to "<<cutName<<endl;
+    current->cd();
+    return;
+  }
+  tilt_space->Write("tilt_space", TObject::kOverwrite);
+  for (int i=0; i<nfuncs; i++) {
+    f_space[i]->Write(Form("f_space%d", i), TObject::kOverwrite);
+  }
+  file->Close();
+  current->cd();
+  cout<<"Fit cuts saved to "<<cutName<<endl;
 }
 
 /*run
@@ -182,12 +353,26 @@ void fit::correct() {
  *Writes all of the corrected data and histograms to a file
  */
 void fit::run(char* dataName, char* storageName) {
+  Checkpoint::State state;
+  bool resuming = false;
+  if (checkpoint.isEnabled()) {
+    checkpoint.setSource(dataName, Form("nfuncs %d", nfuncs));
+    resuming = checkpoint.find(storageName, "correctTree", state);
+    if (resuming && state.complete) {
+      cout<<storageName<<" is already corrected (its checkpoint is complete)"<<endl;
+      return;
+    }
+    if (resuming) resuming = loadCuts(storageName);
+    if (resuming) cout<<"Resuming the correction at event "<<state.cursor<<" from the checkpoint in "<<storageName<<endl;
+  }
   TFile *data = new TFile(dataName, "READ");
-  TFile *storage = new TFile(storageName, "RECREATE");
+  TFile *storage = new TFile(storageName, resuming ? "UPDATE" : "RECREATE");
   TTree *dataTree = (TTree*) data->Get("SortTree");
   c1 = new TCanvas();
 
-  correctTree = new TTree("correctTree", "correctTree");
+  if (resuming) correctTree = (TTree*) storage->Get("correctTree");
+  else correctTree = new TTree("correctTree", "correctTree");
+  if (checkpoint.isEnabled()) correctTree->SetAutoSave(0); //only Checkpoint::save writes the tree header
   histoArray = new TObjArray();
   h = (TH2F*) data->Get("x1_theta");
   x1_notilt = new TH1F("x1_notilt", "fp1 pos untilted theta", 1000, -300, 300);
@@ -202,28 +387,73 @@ void fit::run(char* dataName, char* storageName) {
  
   dataTree->SetBranchAddress("x1", &x1_d);
   dataTree->SetBranchAddress("theta", &theta_d);
-  dataTree->SetBranchAddress("cutFlag", &cutFlag_d);
+  bool masked = (dataTree->GetBranch("gateMask") != NULL); //older SortTrees have cutFlag
+  UInt_t acceptMask = CutFlow::ACCEPTED; //gates an event needs, with the required extra gates (-G)
+  TParameter<Long64_t> *sortAccept = (TParameter<Long64_t>*) data->Get("sort_gates/acceptMask");
+  if (sortAccept) acceptMask = (UInt_t) sortAccept->GetVal();
+  if (masked) dataTree->SetBranchAddress("gateMask", &gateMask_d);
+  else dataTree->SetBranchAddress("cutFlag", &cutFlag_d);
+  TTree *gateTree = (TTree*) data->Get("GateTree"); //gates after re-gating, if any
+  if (gateTree && gateTree->GetEntries() == dataTree->GetEntries()) {
+    cout<<"Using the re-gated cutFlag from the GateTree"<<endl;
+    gateTree->SetBranchStatus("*", 0);
+    gateTree->SetBranchStatus("cutFlag", 1);
+    gateTree->SetBranchAddress("cutFlag", &cutFlag_d);
+  } else {
+    gateTree = NULL;
+  }
 
-  correctTree->Branch("x1_c", &x1_c, "x1_c/F");
-  correctTree->Branch("theta_c", &theta_c, "theta_c/F");
+  if (resuming) {
+    correctTree->SetBranchAddress("x1_c", &x1_c);
+    correctTree->SetBranchAddress("theta_c", &theta_c);
+  } else {
+    correctTree->Branch("x1_c", &x1_c, "x1_c/F");
+    correctTree->Branch("theta_c", &theta_c, "theta_c/F");
+  }
 
   nentries = dataTree->GetEntries();
+  Instrument::Timer read("fit_read");
   for(int event = 0; event<nentries; event++) {
     dataTree->GetEntry(event);
     x1_v.push_back(x1_d);
     theta_v.push_back(theta_d);
+    if (gateTree) gateTree->GetEntry(event);
+    else if (masked) cutFlag_d = ((gateMask_d & acceptMask) == acceptMask);
     cutFlag_v.push_back(cutFlag_d);
   }
+  read.stop();
+  Instrument::count("fit_events_read", nentries);
   
+  cutsLoaded = resuming || (cutName && loadCuts(cutName));
+  if (resuming) { //the notilt histograms are refilled by untilt
+    vector<TH1*> histos;
+    histos.push_back(x1_theta_c);
+    histos.push_back(x1_corrected);
+    Checkpoint::restore(storage, histos);
+    firstEntry = state.cursor;
+  }
   untilt();
   cut();
+  if (cutName && !cutsLoaded) saveCuts();
   correct();
   c1->Close();
  
   x1_v.clear();
   theta_v.clear();
 
-  histoArray->Write();
+  storage->cd();
+  Instrument::Timer write("fit_write");
+  correctTree->Write(correctTree->GetName(), TObject::kOverwrite);
+  histoArray->Write(0, TObject::kOverwrite);
+  saveCorrection();
+  write.stop();
+  Instrument::count("corrtree_zip_bytes", correctTree->GetZipBytes());
+  if (checkpoint.isEnabled()) {
+    state.cursor = nentries;
+    state.treeEntries = correctTree->GetEntries();
+    state.complete = true;
+    checkpoint.save(storage, state, NULL, NULL);
+  }
   data->Close();
   storage->Close();
 }
@@ -2,20 +2,43 @@
  *Main function for sps analysis program
  *4 modes: -r run everything, -a only standard analysis, -f only aberration corrections, -b only background removal
  *Takes mode flag and then the data name (data file name w/o .root)
+ *-p <file> gives an output policy for the SortTree (see OutputPolicy.h)
+ *-c <file> uses the cuts saved in file (one pass, nothing drawn), or saves the cuts drawn to it
+ *          (the analysis gates and the tilt/fit cuts of the aberration correction)
+ *-g <gates> re-gates the histogram file from its SortTree with the cuts from -c, requiring the
+ *          gates listed ("all" or e.g. tcheck1,tcheck2,x1x2_cut), see analysis::regate
+ *-x <file> turns on the si coincidence stage with the timing windows in file (see SiCoinc.h)
+ *-k <file> channel map: which mtdc channels are the fp wires, rf and si (see ChannelMap.h)
+ *-G <file> extra gates evaluated with the analysis gates (see GateGraph.h)
+ *-q runs without canvases (batch), for when every cut comes from -c
+ *-s <fraction> shows the histograms for drawing cuts from a sample first (e.g. 0.05)
+ *-t <file> writes a timing/throughput report of each stage (JSON, or CSV for a .csv name)
+ *-m <seconds> monitors a data file that is still being written (needs -c), see analysis::monitor
+ *-R <seconds> checkpoints the sort and the correction every so many seconds, and resumes them
+ *          from the last checkpoint when run again with the same options (see Checkpoint.h)
+ *-M <list> merges the _histo.root and _corr.root of the runs listed (data names) into those of
+ *          the data name given, then removes the background of the sum (see RunMerge.h)
+ *-j <threads> compresses the output tree baskets in parallel (ROOT implicit multithreading,
+ *          0 = all cores); off by default since it changes the threading of every ROOT call
  *data name should be 20 characters or less
  *
  * Gordon M. Feb 2019
  * Updated by G.M. April 2019 for background removal
+ * Updated by G.M. Aug 2019 for the event cache (data name + _cache.evc)
  */
 
 #include "analysis.h"
 #include "fit.h"
 #include "background.h"
+#include "RunMerge.h"
+#include "CutSet.h"
+#include "Instrument.h"
 #include "TROOT.h"
 #include "TApplication.h"
 #include <iostream>
 #include <unistd.h>
 #include <string>
+#include <cstdlib>
 
 using namespace std;
 
@@ -25,29 +48,44 @@ struct options {
   int onlyAnalyze; // -a
   int runAll; // -r
   int cleanBackground; // -b
+  char *policyName; // -p <file>, SortTree output policy
+  char *cutName; // -c <file>, saved cuts
+  int monitorPeriod; // -m <seconds>, monitor mode
+  double previewFraction; // -s <fraction>, preview histograms for cuts from a sample
+  char *reportName; // -t <file>, stage timing report
+  int batch; // -q
+  char *regateGates; // -g <gates>, re-gate mode
+  char *coincName; // -x <file>, si coincidence windows
+  char *mapName; // -k <file>, mtdc channel map
+  char *gateName; // -G <file>, extra gates
+  int checkpointPeriod; // -R <seconds>, checkpoint/resume
+  char *mergeList; // -M <file>, runs to merge
+  int implicitThreads; // -j <threads>, ROOT implicit MT, -1 = off
 } options;
 
 //flag string for getopt; if expecting value with flag use : after flag letter
-static const char *optString = "farb";
+static const char *optString = "farbqp:c:m:s:t:g:x:k:G:R:M:j:";
 
 int main(int argc, char* argv[]) {
   int opt = 0;
   options.onlyFit = 0;
   options.onlyAnalyze = 0;
   options.runAll = 0;
-  
-  char data[strlen(argv[2])+5]; //data name plus five for .root
-  char histo[strlen(argv[2])+11]; //plus 11 for _histo.root
-  char corr[strlen(argv[2])+10]; //plus 10 for _corr.root
-  char clean[strlen(argv[2])+11]; //plus 11 for _clean.root
+  options.cleanBackground = 0;
+  options.policyName = NULL;
+  options.cutName = NULL;
+  options.monitorPeriod = 0;
+  options.previewFraction = 0;
+  options.reportName = NULL;
+  options.batch = 0;
+  options.regateGates = NULL;
+  options.coincName = NULL;
+  options.mapName = NULL;
+  options.gateName = NULL;
+  options.checkpointPeriod = 0;
+  options.mergeList = NULL;
+  options.implicitThreads = -1;
 
-  strcpy(data, Form("%s.root", argv[2]));
-  strcpy(histo, Form("%s_histo.root", argv[2]));
-  strcpy(corr, Form("%s_corr.root", argv[2]));
-  strcpy(clean, Form("%s_clean.root", argv[2]));
-
-  char *pdata = data; char *phisto = histo; char *pcorr = corr; char *pclean = clean;
- 
   opt =  getopt(argc, argv, optString); // 1 = found arg, -1 = no more valid args
   while( opt != -1) {
     switch(opt) {
@@ -63,26 +101,153 @@ int main(int argc, char* argv[]) {
       case 'b':
         options.cleanBackground = 1;
         break;
+      case 'k':
+        options.mapName = optarg;
+        break;
+      case 'G':
+        options.gateName = optarg;
+        break;
+      case 'j':
+        options.implicitThreads = atoi(optarg);
+        if (options.implicitThreads < 0) options.implicitThreads = 0;
+        break;
+      case 'M':
+        options.mergeList = optarg;
+        break;
+      case 'R':
+        options.checkpointPeriod = atoi(optarg);
+        if (options.checkpointPeriod < 1) options.checkpointPeriod = 1;
+        break;
+      case 'x':
+        options.coincName = optarg;
+        break;
+      case 'g':
+        options.regateGates = optarg;
+        break;
+      case 'q':
+        options.batch = 1;
+        break;
+      case 'p':
+        options.policyName = optarg;
+        break;
+      case 'c':
+        options.cutName = optarg;
+        break;
+      case 's':
+        options.previewFraction = atof(optarg);
+        break;
+      case 't':
+        options.reportName = optarg;
+        break;
+      case 'm':
+        options.monitorPeriod = atoi(optarg);
+        if (options.monitorPeriod < 1) options.monitorPeriod = 1;
+        break;
     }
     opt =  getopt(argc, argv, optString); // iterate to next arg
   }
+  if (optind >= argc) {
+    cout<<"Usage: ./analysis [-r|-a|-f|-b] [-q] [-p policyfile] [-c cutfile] [-m seconds] [-s fraction] [-t reportfile] [-g gates] [-x siwindows] [-k channelmap] [-G gatefile] [-R seconds] [-M runlist] [-j threads] dataname"<<endl;
+    return 1;
+  }
+
+  char data[strlen(argv[optind])+5]; //data name plus five for .root
+  char histo[strlen(argv[optind])+11]; //plus 11 for _histo.root
+  char corr[strlen(argv[optind])+10]; //plus 10 for _corr.root
+  char clean[strlen(argv[optind])+11]; //plus 11 for _clean.root
+  char cache[strlen(argv[optind])+11]; //plus 11 for _cache.evc
+  char mon[strlen(argv[optind])+14]; //plus 14 for _monitor.root
+
+  strcpy(data, Form("%s.root", argv[optind]));
+  strcpy(histo, Form("%s_histo.root", argv[optind]));
+  strcpy(corr, Form("%s_corr.root", argv[optind]));
+  strcpy(clean, Form("%s_clean.root", argv[optind]));
+  strcpy(cache, Form("%s_cache.evc", argv[optind]));
+  strcpy(mon, Form("%s_monitor.root", argv[optind]));
+
+  char *pdata = data; char *phisto = histo; char *pcorr = corr; char *pclean = clean;
+  char *pcache = cache; char *pmon = mon;
+  if (options.reportName) Instrument::enable(options.reportName);
+  ROOT::EnableThreadSafety(); //once, before any of the stages start threads (readers, writers, fills, merging)
+  if (options.implicitThreads >= 0) ROOT::EnableImplicitMT(options.implicitThreads); //parallel basket compression
  
+  if (options.monitorPeriod) {
+    cout<<"Monitoring "<<pdata<<", histograms checkpointed to "<<pmon<<" every "
+        <<options.monitorPeriod<<" s (ctrl-c to stop)"<<endl;
+    analysis a;
+    a.setCutFile(options.cutName);
+    if (options.mapName) a.setChannelMap(options.mapName);
+    if (options.coincName) a.setCoincidence(options.coincName);
+    if (options.gateName) a.setGateFile(options.gateName);
+    a.monitor(pdata, pmon, pcorr, options.monitorPeriod);
+    Instrument::report();
+    return 0;
+  }
+
+  if (options.regateGates) {
+    cout<<"Re-gating "<<phisto<<" with the cuts from "<<(options.cutName ? options.cutName : "(none)")<<endl;
+    analysis a;
+    a.setCutFile(options.cutName);
+    if (options.gateName) a.setGateFile(options.gateName);
+    a.regate(phisto, options.regateGates);
+    Instrument::report();
+    return 0;
+  }
+
+  if (options.mergeList) {
+    cout<<"Merging the runs in "<<options.mergeList<<" into "<<phisto<<" and "<<pcorr<<endl;
+    RunMerge merger;
+    if (!merger.load(options.mergeList) || !merger.run(phisto, pcorr)) return 1;
+    cout<<"Cleaning up the merged corrected position histogram..."<<endl;
+    Backgnd destroy;
+    destroy.run(pcorr, pclean);
+    cout<<"Merge complete."<<endl;
+    Instrument::report();
+    return 0;
+  }
+
+  if (options.batch) { //nothing can be drawn, so every cut has to be in the cut file
+    CutSet saved;
+    if ((options.runAll || options.onlyAnalyze) && !(options.cutName && saved.load(options.cutName))) {
+      cout<<"-q needs a cut file (-c) with the analysis cuts for -a/-r, nothing can be drawn in batch"<<endl;
+      return 1;
+    }
+    if ((options.runAll || options.onlyFit) && !(options.cutName && fit::savedFits(options.cutName) > 0)) {
+      cout<<"-q needs a cut file (-c) with the tilt and fit cuts for -f/-r, nothing can be drawn in batch"<<endl;
+      return 1;
+    }
+  }
+
   TApplication app("app", &argc, argv);
+  if (options.batch) gROOT->SetBatch(kTRUE);
   if ((options.runAll || options.onlyAnalyze)) {
     cout<<"Running SPS analysis..."<<endl;
     cout<<"Data: "<<pdata<<" Histograms: "<<phisto<<endl;
     cout<<"Sorting data..."<<endl;
     analysis a;
-    a.run(pdata, phisto);
+    if (options.policyName) a.loadPolicy(options.policyName);
+    if (options.cutName) a.setCutFile(options.cutName);
+    if (options.previewFraction) a.setPreview(options.previewFraction);
+    if (options.mapName) a.setChannelMap(options.mapName);
+    if (options.coincName) a.setCoincidence(options.coincName);
+    if (options.gateName) a.setGateFile(options.gateName);
+    if (options.checkpointPeriod) a.setCheckpoint(options.checkpointPeriod);
+    a.run(pdata, phisto, pcache);
     cout<<"Sorting complete."<<endl;
   } if (options.runAll || options.onlyFit) {
     int nfuncs;
     cout<<"Running aberration corrections..."<<endl;
     cout<<"Data: "<<pdata<<" Histograms: "<<phisto<<" Corrections: "<<pcorr<<endl;
-    cout<<"Enter number of polynomials to be fitted: ";
-    cin>>nfuncs;
+    nfuncs = options.cutName ? fit::savedFits(options.cutName) : 0;
+    if (nfuncs == 0 && options.checkpointPeriod) nfuncs = fit::savedFits(pcorr); //cuts of a checkpoint
+    if (nfuncs == 0) {
+      cout<<"Enter number of polynomials to be fitted: ";
+      cin>>nfuncs;
+    }
     cout<<"Performing x|theta corrections"<<endl;
     fit f(nfuncs);
+    if (options.cutName) f.setCutFile(options.cutName);
+    if (options.checkpointPeriod) f.setCheckpoint(options.checkpointPeriod);
     f.run(phisto, pcorr);
     cout<<"Corrections complete."<<endl;
   } if (options.runAll || options.cleanBackground) {
@@ -93,5 +258,6 @@ int main(int argc, char* argv[]) {
     cout<<"Background annihiliated."<<endl;
   } 
   cout<<"SPS analysis complete."<<endl;
+  Instrument::report();
   return 0;
 }